@@ -43,6 +43,15 @@ enum FONSglyphBitmap {
 	FONS_GLYPH_BITMAP_REQUIRED = 2,
 };
 
+// Commands of glyph outlines, each followed by its coordinates.
+enum FONSoutlineCommand {
+	FONS_OUTLINE_MOVETO = 0,	// x, y
+	FONS_OUTLINE_LINETO = 1,	// x, y
+	FONS_OUTLINE_QUADTO = 2,	// cx, cy, x, y
+	FONS_OUTLINE_CUBICTO = 3,	// c1x, c1y, c2x, c2y, x, y
+	FONS_OUTLINE_CLOSE = 4,		// hole, 1 when the contour cuts out of the glyph
+};
+
 enum FONSerrorCode {
 	// Font atlas is full.
 	FONS_ATLAS_FULL = 1,
@@ -87,6 +96,16 @@ struct FONStextIter {
 };
 typedef struct FONStextIter FONStextIter;
 
+struct FONSatlasStats {
+	int width, height;
+	int allocatedArea;	// Area taken from the atlas, excluding the gaps which can still be reused.
+	int liveArea;		// Area of the glyphs used within the requested number of frames.
+	int nglyphs;		// Number of glyphs holding bitmap data.
+	float occupancy;	// liveArea relative to the whole atlas.
+	float fragmentation;	// Portion of the allocated area not holding live glyphs.
+};
+typedef struct FONSatlasStats FONSatlasStats;
+
 typedef struct FONScontext FONScontext;
 
 // Constructor and destructor.
@@ -100,9 +119,25 @@ void fonsGetAtlasSize(FONScontext* s, int* width, int* height);
 int fonsExpandAtlas(FONScontext* s, int width, int height);
 // Resets the whole stash.
 int fonsResetAtlas(FONScontext* stash, int width, int height);
+// Resets the atlas keeping the glyphs used within the last 'maxAge' frames, most recently used first.
+// Glyphs which are older or do not fit are evicted and will be rasterized again on demand.
+int fonsEvictAtlas(FONScontext* stash, int width, int height, int maxAge);
+// Advances the frame counter used to track when glyphs were last used.
+void fonsAdvanceFrame(FONScontext* s);
+// Returns atlas usage, glyphs used within the last 'maxAge' frames are considered live.
+void fonsGetAtlasStats(FONScontext* s, int maxAge, FONSatlasStats* stats);
+// Writes the atlas pixels and glyphs of all fonts to a cache file.
+int fonsSaveAtlasCache(FONScontext* s, const char* path);
+// Replaces the atlas with the one stored in a cache file, restoring glyphs of the already added fonts
+// whose data did not change. Glyphs of fonts added later are restored when the font is added, as long
+// as the atlas is not reset or evicted first. Returns the number of glyphs restored right away.
+int fonsLoadAtlasCache(FONScontext* s, const char* path);
 
 // Add fonts
 int fonsAddFont(FONScontext* s, const char* name, const char* path);
+// Maps the font file read-only instead of reading it into memory. Pages are loaded as glyphs are used
+// and shared with other processes using the same file, the mapping is released with the stash.
+int fonsAddFontMapped(FONScontext* s, const char* name, const char* path);
 int fonsAddFontMem(FONScontext* s, const char* name, unsigned char* data, int ndata, int freeData);
 int fonsGetFontByName(FONScontext* s, const char* name);
 
@@ -121,6 +156,9 @@ void fonsSetFont(FONScontext* s, int font);
 
 // Draw text
 float fonsDrawText(FONScontext* s, float x, float y, const char* string, const char* end);
+// Adds the glyphs of the string in the current font, size and blur to the atlas without drawing them.
+// Rasterization may continue in the background. Returns the number of glyphs which did not fit.
+int fonsPrewarmText(FONScontext* s, const char* string, const char* end);
 
 // Measure text
 float fonsTextBounds(FONScontext* s, float x, float y, const char* string, const char* end, float* bounds);
@@ -130,6 +168,10 @@ void fonsVertMetrics(FONScontext* s, float* ascender, float* descender, float* l
 // Text iterator
 int fonsTextIterInit(FONScontext* stash, FONStextIter* iter, float x, float y, const char* str, const char* end, int bitmapOption);
 int fonsTextIterNext(FONScontext* stash, FONStextIter* iter, struct FONSquad* quad);
+// Returns the outline of the glyph last returned by fonsTextIterNext() as FONS_OUTLINE_* commands, placed
+// like its quad. Outlines are cached per font, the returned data is valid until the next call.
+// Returns the number of floats, or 0 when the glyph is empty or outlines are not available.
+int fonsTextIterOutline(FONScontext* stash, FONStextIter* iter, const float** outline);
 
 // Pull texture changes
 const unsigned char* fonsGetTextureData(FONScontext* stash, int* width, int* height);
@@ -145,6 +187,8 @@ void fonsDrawDebug(FONScontext* s, float x, float y);
 
 #define FONS_NOTUSED(v) BX_UNUSED(v)
 
+#include <limits.h>
+
 #ifdef FONS_USE_FREETYPE
 
 #include <ft2build.h>
@@ -252,6 +296,15 @@ int fons__tt_getGlyphKernAdvance(FONSttFontImpl *font, int glyph1, int glyph2)
 	return (int)((ftKerning.x + 32) >> 6);  // Round up and convert to integer
 }
 
+int fons__tt_getGlyphOutline(FONSttFontImpl *font, int glyph, float **commands)
+{
+	// Outlines are not read through FreeType, large text is drawn from the atlas instead.
+	FONS_NOTUSED(font);
+	FONS_NOTUSED(glyph);
+	*commands = NULL;
+	return 0;
+}
+
 #else
 
 #if 0
@@ -330,11 +383,68 @@ int fons__tt_getGlyphKernAdvance(FONSttFontImpl *font, int glyph1, int glyph2)
 	return stbtt_GetGlyphKernAdvance(&font->font, glyph1, glyph2);
 }
 
+// Converts the glyph shape into FONS_OUTLINE_* commands in font units with y up, hole flags are left unset.
+// The returned commands are released with free().
+int fons__tt_getGlyphOutline(FONSttFontImpl *font, int glyph, float **commands)
+{
+	stbtt_vertex* verts = NULL;
+	float* out;
+	int i, n = 0, nverts = stbtt_GetGlyphShape(&font->font, glyph, &verts);
+
+	*commands = NULL;
+	if (nverts <= 0) return 0;
+	out = (float*)malloc(sizeof(float) * (nverts * 7 + 2));
+	if (out == NULL) {
+		stbtt_FreeShape(&font->font, verts);
+		return 0;
+	}
+	for (i = 0; i < nverts; i++) {
+		stbtt_vertex* v = &verts[i];
+		switch (v->type) {
+			case STBTT_vmove:
+				if (n > 0) {
+					out[n++] = FONS_OUTLINE_CLOSE;
+					out[n++] = 0;
+				}
+				out[n++] = FONS_OUTLINE_MOVETO;
+				break;
+			case STBTT_vline:
+				out[n++] = FONS_OUTLINE_LINETO;
+				break;
+			case STBTT_vcurve:
+				out[n++] = FONS_OUTLINE_QUADTO;
+				out[n++] = v->cx;
+				out[n++] = v->cy;
+				break;
+			case STBTT_vcubic:
+				out[n++] = FONS_OUTLINE_CUBICTO;
+				out[n++] = v->cx;
+				out[n++] = v->cy;
+				out[n++] = v->cx1;
+				out[n++] = v->cy1;
+				break;
+			default:
+				continue;
+		}
+		out[n++] = v->x;
+		out[n++] = v->y;
+	}
+	if (n > 0) {
+		out[n++] = FONS_OUTLINE_CLOSE;
+		out[n++] = 0;
+	}
+	stbtt_FreeShape(&font->font, verts);
+
+	*commands = out;
+	return n;
+}
+
 #endif
 
 #ifndef FONS_SCRATCH_BUF_SIZE
 #	define FONS_SCRATCH_BUF_SIZE 96000
 #endif
+// Initial size of the per font glyph lookup table, must be a power of two.
 #ifndef FONS_HASH_LUT_SIZE
 #	define FONS_HASH_LUT_SIZE 256
 #endif
@@ -347,6 +457,10 @@ int fons__tt_getGlyphKernAdvance(FONSttFontImpl *font, int glyph1, int glyph2)
 #ifndef FONS_INIT_ATLAS_NODES
 #	define FONS_INIT_ATLAS_NODES 256
 #endif
+// Bytes at the start of a font hashed to tell whether the atlas cache was made with the same font.
+#ifndef FONS_CACHE_KEY_PREFIX
+#	define FONS_CACHE_KEY_PREFIX 4096
+#endif
 #ifndef FONS_VERTEX_COUNT
 #	define FONS_VERTEX_COUNT 1024
 #endif
@@ -356,16 +470,84 @@ int fons__tt_getGlyphKernAdvance(FONSttFontImpl *font, int glyph1, int glyph2)
 #ifndef FONS_MAX_FALLBACKS
 #	define FONS_MAX_FALLBACKS 20
 #endif
+// Kerning of glyph pairs below this index is cached in a dense table, which covers ASCII in most fonts.
+#ifndef FONS_KERN_DENSE_SIZE
+#	define FONS_KERN_DENSE_SIZE 128
+#endif
+// Maximum number of other kerning pairs cached per font.
+#ifndef FONS_MAX_KERN_PAIRS
+#	define FONS_MAX_KERN_PAIRS 32768
+#endif
+// Number of worker threads rasterizing glyphs, 0 rasterizes on the calling thread.
+#ifndef FONS_RASTER_THREADS
+#	define FONS_RASTER_THREADS 3
+#endif
+// Smaller batches of new glyphs are rasterized on the calling thread.
+#ifndef FONS_RASTER_BATCH
+#	define FONS_RASTER_BATCH 16
+#endif
+#ifdef FONS_USE_FREETYPE
+// FreeType renders from the glyph slot of the face, which can not be shared between threads.
+#	undef FONS_RASTER_THREADS
+#	define FONS_RASTER_THREADS 0
+#endif
+
+#if FONS_RASTER_THREADS > 0
+#	include <bx/cpu.h>
+#	include <bx/semaphore.h>
+#	include <bx/thread.h>
+#endif
+
+// Glyph blur is vectorized with SSE2 or NEON, define FONS_NO_SIMD to use the scalar filter only.
+#if !defined(FONS_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#	define FONS_BLUR_SSE2 1
+#	include <emmintrin.h>
+#elif !defined(FONS_NO_SIMD) && (defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64))
+#	define FONS_BLUR_NEON 1
+#	include <arm_neon.h>
+#endif
+
+#ifdef _WIN32
+#	ifndef WIN32_LEAN_AND_MEAN
+#		define WIN32_LEAN_AND_MEAN
+#	endif
+#	ifndef NOMINMAX
+#		define NOMINMAX
+#	endif
+#	include <windows.h>
+#else
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+static unsigned long long fons__glyphKey(unsigned int codepoint, short size, short blur)
+{
+	return ((unsigned long long)codepoint << 32) | ((unsigned long long)(unsigned short)size << 16) | (unsigned short)blur;
+}
+
+static unsigned int fons__hashKey(unsigned long long key)
+{
+	// MurmurHash3 finalizer, spreads neighbouring codepoints and sizes over the table.
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53ULL;
+	key ^= key >> 33;
+	return (unsigned int)key;
+}
 
-static unsigned int fons__hashint(unsigned int a)
+// FNV-1a
+static unsigned int fons__hashData(const unsigned char* data, int size)
 {
-	a += ~(a<<15);
-	a ^=  (a>>10);
-	a +=  (a<<3);
-	a ^=  (a>>6);
-	a += ~(a<<11);
-	a ^=  (a>>16);
-	return a;
+	unsigned int h = 2166136261u;
+	int i;
+	for (i = 0; i < size; i++) {
+		h ^= data[i];
+		h *= 16777619u;
+	}
+	return h;
 }
 
 static int fons__mini(int a, int b)
@@ -373,6 +555,40 @@ static int fons__mini(int a, int b)
 	return a < b ? a : b;
 }
 
+static unsigned int fons__readU32(const unsigned char* p)
+{
+	return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | (unsigned int)p[3];
+}
+
+// Identifies font data in the atlas cache without reading the whole font, which would load
+// every page of a mapped font. The start of the font holds the table directory, with the
+// checksum of each table, and the head table holds the checksum of the whole font.
+static unsigned int fons__fontCacheKey(const unsigned char* data, int size)
+{
+	unsigned int h = fons__hashData(data, fons__mini(size, FONS_CACHE_KEY_PREFIX));
+	unsigned int base = 0, ntables, i;
+
+	// Font collections point to the table directory of their first font.
+	if (size >= 16 && memcmp(data, "ttcf", 4) == 0)
+		base = fons__readU32(data + 12);
+	if ((size_t)base + 12 > (size_t)size)
+		return h;
+
+	ntables = ((unsigned int)data[base+4] << 8) | data[base+5];
+	for (i = 0; i < ntables && (size_t)base + 12 + 16*(i+1) <= (size_t)size; i++) {
+		const unsigned char* table = data + base + 12 + 16*i;
+		if (memcmp(table, "head", 4) == 0) {
+			unsigned int offset = fons__readU32(table + 8);
+			if ((size_t)offset + 12 <= (size_t)size) {
+				h ^= fons__readU32(data + offset + 8); // checkSumAdjustment
+				h *= 16777619u;
+			}
+			break;
+		}
+	}
+	return h;
+}
+
 static int fons__maxi(int a, int b)
 {
 	return a > b ? a : b;
@@ -382,13 +598,43 @@ struct FONSglyph
 {
 	unsigned int codepoint;
 	int index;
-	int next;
 	short size, blur;
 	short x0,y0,x1,y1;
 	short xadv,xoff,yoff;
+	int lastUsed;
 };
 typedef struct FONSglyph FONSglyph;
 
+// Glyph lookup slot, keyed by packed codepoint, size and blur.
+struct FONSglyphSlot
+{
+	unsigned long long key;
+	int index; // -1 for an empty slot
+};
+typedef struct FONSglyphSlot FONSglyphSlot;
+
+#define FONS_KERN_EMPTY 0xffffffffu
+
+// Cached kerning of a glyph pair, keyed by both glyph indices.
+struct FONSkernSlot
+{
+	unsigned int key; // FONS_KERN_EMPTY for an empty slot
+	int kern;
+};
+typedef struct FONSkernSlot FONSkernSlot;
+
+// Read-only memory mapped file.
+struct FONSfileMap
+{
+	unsigned char* data;
+	size_t size;
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#endif
+};
+typedef struct FONSfileMap FONSfileMap;
+
 struct FONSfont
 {
 	FONSttFontImpl font;
@@ -396,13 +642,25 @@ struct FONSfont
 	unsigned char* data;
 	int dataSize;
 	unsigned char freeData;
+	FONSfileMap map; // Font file mapped by fonsAddFontMapped().
 	float ascender;
 	float descender;
 	float lineh;
 	FONSglyph* glyphs;
 	int cglyphs;
 	int nglyphs;
-	int lut[FONS_HASH_LUT_SIZE];
+	FONSglyphSlot* table; // Open addressing, kept at most half full.
+	int ctable;
+	short* kernDense; // Allocated on first use, SHRT_MIN marks pairs not queried yet.
+	FONSkernSlot* kernTable; // Open addressing, kept at most half full.
+	int nkern;
+	int ckern;
+	FONSglyphSlot* outlineTable; // Keyed by codepoint, indexes the outline length stored in outlineData.
+	int coutlineTable;
+	int noutlines;
+	float* outlineData; // Outline commands in units of the font size, y down.
+	int noutlineData;
+	int coutlineData;
 	int fallbacks[FONS_MAX_FALLBACKS];
 	int nfallbacks;
 };
@@ -424,15 +682,43 @@ struct FONSatlasNode {
 };
 typedef struct FONSatlasNode FONSatlasNode;
 
+struct FONSatlasRect {
+	short x, y, width, height;
+};
+typedef struct FONSatlasRect FONSatlasRect;
+
+// Glyphs read from an atlas cache for a font which is not added yet.
+struct FONScachedFont {
+	char name[64];
+	unsigned int key;
+	int dataSize;
+	FONSglyph* glyphs;
+	int nglyphs;
+};
+typedef struct FONScachedFont FONScachedFont;
+
 struct FONSatlas
 {
 	int width, height;
 	FONSatlasNode* nodes;
 	int nnodes;
 	int cnodes;
+	FONSatlasRect* waste;
+	int nwaste;
+	int cwaste;
 };
 typedef struct FONSatlas FONSatlas;
 
+struct FONSrasterJob
+{
+	FONSttFontImpl* font;
+	int glyph;
+	float scale;
+	short x, y, width, height; // Glyph rect in the atlas, including padding.
+	short pad, blur;
+};
+typedef struct FONSrasterJob FONSrasterJob;
+
 struct FONScontext
 {
 	FONSparams params;
@@ -449,12 +735,27 @@ struct FONScontext
 	int nverts;
 	unsigned char* scratch;
 	int nscratch;
+	int cscratch;
+	FONSrasterJob* jobs;
+	int njobs;
+	int cjobs;
+	struct FONSrasterPool* pool;
+	float* outline;
+	int coutline;
 	FONSstate states[FONS_MAX_STATES];
 	int nstates;
+	int frame;
+	FONScachedFont* cachedFonts;
+	int ncachedFonts;
 	void (*handleError)(void* uptr, int error, int val);
 	void* errorUptr;
 };
 
+#if FONS_RASTER_THREADS > 0
+static struct FONSrasterPool* fons__createRasterPool(void);
+static void fons__deleteRasterPool(struct FONSrasterPool* pool);
+#endif
+
 #if 0 // defined(STB_TRUETYPE_IMPLEMENTATION)
 
 static void* fons__tmpalloc(size_t size, void* up)
@@ -523,12 +824,15 @@ static unsigned int fons__decutf8(unsigned int* state, unsigned int* codep, unsi
 	return *state;
 }
 
-// Atlas based on Skyline Bin Packer by Jukka Jylänki
+// Atlas based on Skyline Bin Packer by Jukka Jylänki, with waste map.
+// The gaps left under the skyline when a rect is placed over lower segments
+// are kept in the waste map and reused for later rects that fit in them.
 
 static void fons__deleteAtlas(FONSatlas* atlas)
 {
 	if (atlas == NULL) return;
 	if (atlas->nodes != NULL) free(atlas->nodes);
+	if (atlas->waste != NULL) free(atlas->waste);
 	free(atlas);
 }
 
@@ -613,12 +917,76 @@ static void fons__atlasReset(FONSatlas* atlas, int w, int h)
 	atlas->nodes[0].y = 0;
 	atlas->nodes[0].width = (short)w;
 	atlas->nnodes++;
+
+	atlas->nwaste = 0;
+}
+
+static int fons__atlasAddWaste(FONSatlas* atlas, int x, int y, int w, int h)
+{
+	// Gaps smaller than the padding of a glyph can never be used.
+	if (w < 4 || h < 4)
+		return 1;
+	if (atlas->nwaste+1 > atlas->cwaste) {
+		atlas->cwaste = atlas->cwaste == 0 ? 64 : atlas->cwaste * 2;
+		atlas->waste = (FONSatlasRect*)realloc(atlas->waste, sizeof(FONSatlasRect) * atlas->cwaste);
+		if (atlas->waste == NULL)
+			return 0;
+	}
+	atlas->waste[atlas->nwaste].x = (short)x;
+	atlas->waste[atlas->nwaste].y = (short)y;
+	atlas->waste[atlas->nwaste].width = (short)w;
+	atlas->waste[atlas->nwaste].height = (short)h;
+	atlas->nwaste++;
+	return 1;
+}
+
+static int fons__atlasAddWasteRect(FONSatlas* atlas, int rw, int rh, int* rx, int* ry)
+{
+	int i, besti = -1, bestFit = 0x7fffffff;
+	FONSatlasRect r;
+
+	// Best short side fit.
+	for (i = 0; i < atlas->nwaste; i++) {
+		int fit;
+		if (atlas->waste[i].width < rw || atlas->waste[i].height < rh)
+			continue;
+		fit = fons__mini(atlas->waste[i].width - rw, atlas->waste[i].height - rh);
+		if (fit < bestFit) {
+			besti = i;
+			bestFit = fit;
+		}
+	}
+	if (besti == -1)
+		return 0;
+
+	r = atlas->waste[besti];
+	atlas->waste[besti] = atlas->waste[--atlas->nwaste];
+	*rx = r.x;
+	*ry = r.y;
+
+	// Split the remainder along the shorter leftover axis.
+	if (r.width - rw < r.height - rh) {
+		fons__atlasAddWaste(atlas, r.x + rw, r.y, r.width - rw, rh);
+		fons__atlasAddWaste(atlas, r.x, r.y + rh, r.width, r.height - rh);
+	} else {
+		fons__atlasAddWaste(atlas, r.x + rw, r.y, r.width - rw, r.height);
+		fons__atlasAddWaste(atlas, r.x, r.y + rh, rw, r.height - rh);
+	}
+	return 1;
 }
 
 static int fons__atlasAddSkylineLevel(FONSatlas* atlas, int idx, int x, int y, int w, int h)
 {
 	int i;
 
+	// Remember the gaps which get covered by the new segment.
+	for (i = idx; i < atlas->nnodes && atlas->nodes[i].x < x + w; i++) {
+		int x0 = fons__maxi(atlas->nodes[i].x, x);
+		int x1 = fons__mini(atlas->nodes[i].x + atlas->nodes[i].width, x + w);
+		if (atlas->nodes[i].y < y)
+			fons__atlasAddWaste(atlas, x0, atlas->nodes[i].y, x1 - x0, y - atlas->nodes[i].y);
+	}
+
 	// Insert new node
 	if (fons__atlasInsertNode(atlas, idx, x, y+h, w) == 0)
 		return 0;
@@ -678,6 +1046,10 @@ static int fons__atlasAddRect(FONSatlas* atlas, int rw, int rh, int* rx, int* ry
 	int besth = atlas->height, bestw = atlas->width, besti = -1;
 	int bestx = -1, besty = -1, i;
 
+	// Try to fill a gap under the skyline first.
+	if (fons__atlasAddWasteRect(atlas, rw, rh, rx, ry))
+		return 1;
+
 	// Bottom left fit heuristic.
 	for (i = 0; i < atlas->nnodes; i++) {
 		int y = fons__atlasRectFits(atlas, i, rw, rh);
@@ -740,6 +1112,12 @@ FONScontext* fonsCreateInternal(FONSparams* params)
 	// Allocate scratch buffer.
 	stash->scratch = (unsigned char*)malloc(FONS_SCRATCH_BUF_SIZE);
 	if (stash->scratch == NULL) goto error;
+	stash->cscratch = FONS_SCRATCH_BUF_SIZE;
+
+#if FONS_RASTER_THREADS > 0
+	stash->pool = fons__createRasterPool();
+	if (stash->pool == NULL) goto error;
+#endif
 
 	// Initialize implementation library
 	if (!fons__tt_init(stash)) goto error;
@@ -862,14 +1240,168 @@ void fonsClearState(FONScontext* stash)
 	state->align = FONS_ALIGN_LEFT | FONS_ALIGN_BASELINE;
 }
 
+static int fons__mapFile(FONSfileMap* map, const char* path)
+{
+#ifdef _WIN32
+	LARGE_INTEGER size;
+	memset(map, 0, sizeof(FONSfileMap));
+	map->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (map->file == INVALID_HANDLE_VALUE) return 0;
+	if (!GetFileSizeEx(map->file, &size) || size.QuadPart == 0) goto error;
+	map->mapping = CreateFileMappingA(map->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (map->mapping == NULL) goto error;
+	map->data = (unsigned char*)MapViewOfFile(map->mapping, FILE_MAP_READ, 0, 0, 0);
+	if (map->data == NULL) goto error;
+	map->size = (size_t)size.QuadPart;
+	return 1;
+
+error:
+	if (map->mapping != NULL) CloseHandle(map->mapping);
+	CloseHandle(map->file);
+	memset(map, 0, sizeof(FONSfileMap));
+	return 0;
+#else
+	struct stat st;
+	void* data;
+	int fd;
+	memset(map, 0, sizeof(FONSfileMap));
+	fd = open(path, O_RDONLY);
+	if (fd < 0) return 0;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return 0;
+	}
+	data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) return 0;
+	map->data = (unsigned char*)data;
+	map->size = (size_t)st.st_size;
+	return 1;
+#endif
+}
+
+static void fons__unmapFile(FONSfileMap* map)
+{
+	if (map->data == NULL) return;
+#ifdef _WIN32
+	UnmapViewOfFile(map->data);
+	CloseHandle(map->mapping);
+	CloseHandle(map->file);
+#else
+	munmap(map->data, map->size);
+#endif
+	memset(map, 0, sizeof(FONSfileMap));
+}
+
+static int fons__findGlyph(FONSfont* font, unsigned long long key)
+{
+	unsigned int mask = (unsigned int)font->ctable - 1;
+	unsigned int i = fons__hashKey(key) & mask;
+	while (font->table[i].index != -1) {
+		if (font->table[i].key == key)
+			return font->table[i].index;
+		i = (i + 1) & mask;
+	}
+	return -1;
+}
+
+static void fons__insertGlyph(FONSfont* font, int index)
+{
+	FONSglyph* glyph = &font->glyphs[index];
+	unsigned long long key = fons__glyphKey(glyph->codepoint, glyph->size, glyph->blur);
+	unsigned int mask = (unsigned int)font->ctable - 1;
+	unsigned int i = fons__hashKey(key) & mask;
+	while (font->table[i].index != -1)
+		i = (i + 1) & mask;
+	font->table[i].key = key;
+	font->table[i].index = index;
+}
+
+// Empties the lookup table, growing it to keep 'nglyphs' under half of its size.
+static int fons__resetGlyphTable(FONSfont* font, int nglyphs)
+{
+	int i, ctable = font->ctable;
+	while (nglyphs*2 > ctable)
+		ctable *= 2;
+	if (ctable != font->ctable) {
+		FONSglyphSlot* table = (FONSglyphSlot*)realloc(font->table, sizeof(FONSglyphSlot) * ctable);
+		if (table == NULL) return 0;
+		font->table = table;
+		font->ctable = ctable;
+	}
+	for (i = 0; i < font->ctable; i++)
+		font->table[i].index = -1;
+	return 1;
+}
+
+static int fons__rebuildGlyphTable(FONSfont* font)
+{
+	int i;
+	if (!fons__resetGlyphTable(font, font->nglyphs))
+		return 0;
+	for (i = 0; i < font->nglyphs; i++)
+		fons__insertGlyph(font, i);
+	return 1;
+}
+
 static void fons__freeFont(FONSfont* font)
 {
 	if (font == NULL) return;
 	if (font->glyphs) free(font->glyphs);
-	if (font->freeData && font->data) free(font->data);
+	if (font->table) free(font->table);
+	if (font->kernDense) free(font->kernDense);
+	if (font->kernTable) free(font->kernTable);
+	if (font->outlineTable) free(font->outlineTable);
+	if (font->outlineData) free(font->outlineData);
+	if (font->map.data) fons__unmapFile(&font->map);
+	else if (font->freeData && font->data) free(font->data);
 	free(font);
 }
 
+static void fons__clearCachedFonts(FONScontext* stash)
+{
+	int i;
+	for (i = 0; i < stash->ncachedFonts; i++)
+		free(stash->cachedFonts[i].glyphs);
+	free(stash->cachedFonts);
+	stash->cachedFonts = NULL;
+	stash->ncachedFonts = 0;
+}
+
+// Restores the glyphs an atlas cache holds for a font added after the cache was loaded.
+static void fons__restoreCachedGlyphs(FONScontext* stash, FONSfont* font)
+{
+	unsigned int key;
+	int i, j;
+	if (stash->ncachedFonts == 0) return;
+
+	key = fons__fontCacheKey(font->data, font->dataSize);
+	for (i = 0; i < stash->ncachedFonts; i++) {
+		FONScachedFont* cached = &stash->cachedFonts[i];
+		if (cached->key != key || cached->dataSize != font->dataSize || strcmp(cached->name, font->name) != 0)
+			continue;
+
+		if (cached->nglyphs > font->cglyphs) {
+			FONSglyph* glyphs = (FONSglyph*)realloc(font->glyphs, sizeof(FONSglyph) * cached->nglyphs);
+			if (glyphs == NULL) return;
+			font->glyphs = glyphs;
+			font->cglyphs = cached->nglyphs;
+		}
+		memcpy(font->glyphs, cached->glyphs, sizeof(FONSglyph) * cached->nglyphs);
+		font->nglyphs = cached->nglyphs;
+		for (j = 0; j < font->nglyphs; j++)
+			font->glyphs[j].lastUsed = stash->frame;
+		if (!fons__rebuildGlyphTable(font)) {
+			font->nglyphs = 0;
+			return;
+		}
+
+		free(cached->glyphs);
+		stash->cachedFonts[i] = stash->cachedFonts[--stash->ncachedFonts];
+		return;
+	}
+}
+
 static int fons__allocFont(FONScontext* stash)
 {
 	FONSfont* font = NULL;
@@ -888,6 +1420,10 @@ static int fons__allocFont(FONScontext* stash)
 	font->cglyphs = FONS_INIT_GLYPHS;
 	font->nglyphs = 0;
 
+	font->table = (FONSglyphSlot*)malloc(sizeof(FONSglyphSlot) * FONS_HASH_LUT_SIZE);
+	if (font->table == NULL) goto error;
+	font->ctable = FONS_HASH_LUT_SIZE;
+
 	stash->fonts[stash->nfonts++] = font;
 	return stash->nfonts-1;
 
@@ -925,9 +1461,29 @@ error:
 	return FONS_INVALID;
 }
 
+int fonsAddFontMapped(FONScontext* stash, const char* name, const char* path)
+{
+	FONSfileMap map;
+	int idx;
+
+	if (!fons__mapFile(&map, path)) return FONS_INVALID;
+	if (map.size > INT_MAX) goto error;
+
+	idx = fonsAddFontMem(stash, name, map.data, (int)map.size, 0);
+	if (idx == FONS_INVALID) goto error;
+
+	// The font owns the mapping from now on.
+	stash->fonts[idx]->map = map;
+	return idx;
+
+error:
+	fons__unmapFile(&map);
+	return FONS_INVALID;
+}
+
 int fonsAddFontMem(FONScontext* stash, const char* name, unsigned char* data, int dataSize, int freeData)
 {
-	int i, ascent, descent, fh, lineGap;
+	int ascent, descent, fh, lineGap;
 	FONSfont* font;
 
 	int idx = fons__allocFont(stash);
@@ -940,8 +1496,7 @@ int fonsAddFontMem(FONScontext* stash, const char* name, unsigned char* data, in
 	font->name[sizeof(font->name)-1] = '\0';
 
 	// Init hash lookup.
-	for (i = 0; i < FONS_HASH_LUT_SIZE; ++i)
-		font->lut[i] = -1;
+	fons__resetGlyphTable(font, 0);
 
 	// Read in the font data.
 	font->dataSize = dataSize;
@@ -960,6 +1515,8 @@ int fonsAddFontMem(FONScontext* stash, const char* name, unsigned char* data, in
 	font->descender = (float)descent / (float)fh;
 	font->lineh = (float)(fh + lineGap) / (float)fh;
 
+	fons__restoreCachedGlyphs(stash, font);
+
 	return idx;
 
 error:
@@ -990,16 +1547,162 @@ static FONSglyph* fons__allocGlyph(FONSfont* font)
 	return &font->glyphs[font->nglyphs-1];
 }
 
-
 // Based on Exponential blur, Jani Huhtanen, 2006
 
 #define APREC 16
 #define ZPREC 7
 
+#if defined(FONS_BLUR_SSE2) || defined(FONS_BLUR_NEON)
+
+// The recursive filter runs on 8 rows or columns at once. Each lane computes exactly
+// z += (alpha * ((v << ZPREC) - z)) >> APREC as the scalar filter does.
+#define FONS_BLUR_LANES 8
+
+#ifdef FONS_BLUR_SSE2
+
+// 16-bit lanes, z stays within [0, 255 << ZPREC] and alpha within [0, 1 << APREC).
+typedef __m128i FONSblurLanes;
+
+static FONSblurLanes fons__blurSplat(int v)
+{
+	return _mm_set1_epi16((short)v);
+}
+
+static FONSblurLanes fons__blurLoad(const unsigned char* p)
+{
+	return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)p), _mm_setzero_si128());
+}
+
+static void fons__blurStore(unsigned char* p, FONSblurLanes z)
+{
+	_mm_storel_epi64((__m128i*)p, _mm_packus_epi16(_mm_srli_epi16(z, ZPREC), _mm_setzero_si128()));
+}
+
+static FONSblurLanes fons__blurGather(const unsigned char* p, int stride)
+{
+	return _mm_setr_epi16(p[0], p[stride], p[2*stride], p[3*stride],
+						  p[4*stride], p[5*stride], p[6*stride], p[7*stride]);
+}
+
+static void fons__blurScatter(unsigned char* p, int stride, FONSblurLanes z)
+{
+	z = _mm_srli_epi16(z, ZPREC);
+	p[0] = (unsigned char)_mm_extract_epi16(z, 0);
+	p[stride] = (unsigned char)_mm_extract_epi16(z, 1);
+	p[2*stride] = (unsigned char)_mm_extract_epi16(z, 2);
+	p[3*stride] = (unsigned char)_mm_extract_epi16(z, 3);
+	p[4*stride] = (unsigned char)_mm_extract_epi16(z, 4);
+	p[5*stride] = (unsigned char)_mm_extract_epi16(z, 5);
+	p[6*stride] = (unsigned char)_mm_extract_epi16(z, 6);
+	p[7*stride] = (unsigned char)_mm_extract_epi16(z, 7);
+}
+
+static FONSblurLanes fons__blurStep(FONSblurLanes z, FONSblurLanes v, FONSblurLanes alpha)
+{
+	__m128i d = _mm_sub_epi16(_mm_slli_epi16(v, ZPREC), z);
+	// mulhi takes alpha as signed, which subtracts d from the product when alpha >= 32768.
+	__m128i p = _mm_mulhi_epi16(d, alpha);
+	p = _mm_add_epi16(p, _mm_and_si128(d, _mm_srai_epi16(alpha, 15)));
+	return _mm_add_epi16(z, p);
+}
+
+#else
+
+// 32-bit lanes, alpha * ((v << ZPREC) - z) fits in 32 bits.
+struct FONSblurLanes {
+	int32x4_t lo, hi;
+};
+typedef struct FONSblurLanes FONSblurLanes;
+
+static FONSblurLanes fons__blurSplat(int v)
+{
+	FONSblurLanes r;
+	r.lo = r.hi = vdupq_n_s32(v);
+	return r;
+}
+
+static FONSblurLanes fons__blurWiden(uint8x8_t v)
+{
+	FONSblurLanes r;
+	uint16x8_t w = vmovl_u8(v);
+	r.lo = vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(w)));
+	r.hi = vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(w)));
+	return r;
+}
+
+static uint8x8_t fons__blurNarrow(FONSblurLanes z)
+{
+	uint16x4_t lo = vmovn_u32(vreinterpretq_u32_s32(vshrq_n_s32(z.lo, ZPREC)));
+	uint16x4_t hi = vmovn_u32(vreinterpretq_u32_s32(vshrq_n_s32(z.hi, ZPREC)));
+	return vmovn_u16(vcombine_u16(lo, hi));
+}
+
+static FONSblurLanes fons__blurLoad(const unsigned char* p)
+{
+	return fons__blurWiden(vld1_u8(p));
+}
+
+static void fons__blurStore(unsigned char* p, FONSblurLanes z)
+{
+	vst1_u8(p, fons__blurNarrow(z));
+}
+
+static FONSblurLanes fons__blurGather(const unsigned char* p, int stride)
+{
+	unsigned char v[FONS_BLUR_LANES];
+	int i;
+	for (i = 0; i < FONS_BLUR_LANES; i++)
+		v[i] = p[i*stride];
+	return fons__blurWiden(vld1_u8(v));
+}
+
+static void fons__blurScatter(unsigned char* p, int stride, FONSblurLanes z)
+{
+	unsigned char v[FONS_BLUR_LANES];
+	int i;
+	vst1_u8(v, fons__blurNarrow(z));
+	for (i = 0; i < FONS_BLUR_LANES; i++)
+		p[i*stride] = v[i];
+}
+
+static FONSblurLanes fons__blurStep(FONSblurLanes z, FONSblurLanes v, FONSblurLanes alpha)
+{
+	int32x4_t dlo = vsubq_s32(vshlq_n_s32(v.lo, ZPREC), z.lo);
+	int32x4_t dhi = vsubq_s32(vshlq_n_s32(v.hi, ZPREC), z.hi);
+	z.lo = vaddq_s32(z.lo, vshrq_n_s32(vmulq_s32(dlo, alpha.lo), APREC));
+	z.hi = vaddq_s32(z.hi, vshrq_n_s32(vmulq_s32(dhi, alpha.hi), APREC));
+	return z;
+}
+
+#endif // FONS_BLUR_SSE2
+
+#endif // FONS_BLUR_SSE2 || FONS_BLUR_NEON
+
 static void fons__blurCols(unsigned char* dst, int w, int h, int dstStride, int alpha)
 {
-	int x, y;
-	for (y = 0; y < h; y++) {
+	int x, y = 0;
+#if defined(FONS_BLUR_SSE2) || defined(FONS_BLUR_NEON)
+	const FONSblurLanes va = fons__blurSplat(alpha);
+	int i;
+	for (; y+FONS_BLUR_LANES <= h; y += FONS_BLUR_LANES) {
+		FONSblurLanes z = fons__blurSplat(0); // force zero border
+		for (x = 1; x < w; x++) {
+			z = fons__blurStep(z, fons__blurGather(dst+x, dstStride), va);
+			fons__blurScatter(dst+x, dstStride, z);
+		}
+		for (i = 0; i < FONS_BLUR_LANES; i++)
+			dst[i*dstStride + w-1] = 0; // force zero border
+		z = fons__blurSplat(0);
+		for (x = w-2; x >= 0; x--) {
+			z = fons__blurStep(z, fons__blurGather(dst+x, dstStride), va);
+			fons__blurScatter(dst+x, dstStride, z);
+		}
+		for (i = 0; i < FONS_BLUR_LANES; i++)
+			dst[i*dstStride] = 0; // force zero border
+		dst += dstStride * FONS_BLUR_LANES;
+	}
+#endif
+	for (; y < h; y++) {
 		int z = 0; // force zero border
 		for (x = 1; x < w; x++) {
 			z += (alpha * (((int)(dst[x]) << ZPREC) - z)) >> APREC;
@@ -1018,8 +1721,26 @@ static void fons__blurCols(unsigned char* dst, int w, int h, int dstStride, int
 
 static void fons__blurRows(unsigned char* dst, int w, int h, int dstStride, int alpha)
 {
-	int x, y;
-	for (x = 0; x < w; x++) {
+	int x = 0, y;
+#if defined(FONS_BLUR_SSE2) || defined(FONS_BLUR_NEON)
+	const FONSblurLanes va = fons__blurSplat(alpha);
+	for (; x+FONS_BLUR_LANES <= w; x += FONS_BLUR_LANES) {
+		FONSblurLanes z = fons__blurSplat(0); // force zero border
+		for (y = dstStride; y < h*dstStride; y += dstStride) {
+			z = fons__blurStep(z, fons__blurLoad(dst+y), va);
+			fons__blurStore(dst+y, z);
+		}
+		memset(&dst[(h-1)*dstStride], 0, FONS_BLUR_LANES); // force zero border
+		z = fons__blurSplat(0);
+		for (y = (h-2)*dstStride; y >= 0; y -= dstStride) {
+			z = fons__blurStep(z, fons__blurLoad(dst+y), va);
+			fons__blurStore(dst+y, z);
+		}
+		memset(dst, 0, FONS_BLUR_LANES); // force zero border
+		dst += FONS_BLUR_LANES;
+	}
+#endif
+	for (; x < w; x++) {
 		int z = 0; // force zero border
 		for (y = dstStride; y < h*dstStride; y += dstStride) {
 			z += (alpha * (((int)(dst[y]) << ZPREC) - z)) >> APREC;
@@ -1056,39 +1777,237 @@ static void fons__blur(FONScontext* stash, unsigned char* dst, int w, int h, int
 //	fons__blurcols(dst, w, h, dstStride, alpha);
 }
 
-static FONSglyph* fons__getGlyph(FONScontext* stash, FONSfont* font, unsigned int codepoint,
-								 short isize, short iblur, int bitmapOption)
+static void fons__rasterizeGlyph(const FONSrasterJob* job, unsigned char** scratch, int* cscratch,
+								 unsigned char* texData, int stride)
 {
-	int i, g, advance, lsb, x0, y0, x1, y1, gw, gh, gx, gy, x, y;
-	float scale;
-	FONSglyph* glyph = NULL;
-	unsigned int h;
-	float size = isize/10.0f;
-	int pad, added;
-	unsigned char* bdst;
+	int y, size = job->width * job->height;
 	unsigned char* dst;
-	FONSfont* renderFont = font;
 
-	if (isize < 2) return NULL;
-	if (iblur > 20) iblur = 20;
-	pad = iblur+2;
+	// Glyphs are rendered into thread local scratch first, and blurred there.
+	if (size > *cscratch) {
+		unsigned char* data = (unsigned char*)realloc(*scratch, size);
+		if (data == NULL) return;
+		*scratch = data;
+		*cscratch = size;
+	}
+	// Make sure there is one pixel empty border.
+	memset(*scratch, 0, size);
+	fons__tt_renderGlyphBitmap(job->font, *scratch + job->pad + job->pad * job->width,
+							   job->width - job->pad*2, job->height - job->pad*2, job->width,
+							   job->scale, job->scale, job->glyph);
+	if (job->blur > 0)
+		fons__blur(NULL, *scratch, job->width, job->height, job->width, job->blur);
+
+	dst = &texData[job->x + job->y * stride];
+	for (y = 0; y < job->height; y++)
+		memcpy(&dst[y * stride], &(*scratch)[y * job->width], job->width);
+}
+
+#if FONS_RASTER_THREADS > 0
+
+struct FONSrasterWorker
+{
+	bx::Thread thread;
+	struct FONSrasterPool* pool;
+	unsigned char* scratch;
+	int cscratch;
+};
+typedef struct FONSrasterWorker FONSrasterWorker;
+
+struct FONSrasterPool
+{
+	FONSrasterWorker workers[FONS_RASTER_THREADS];
+	bx::Semaphore start;
+	bx::Semaphore done;
+	FONSrasterJob* jobs;
+	int njobs;
+	int cjobs;
+	int32_t next;
+	unsigned char* texData;
+	int stride;
+	int busy;
+	int quit;
+};
+typedef struct FONSrasterPool FONSrasterPool;
+
+static void fons__runRasterJobs(FONSrasterPool* pool, unsigned char** scratch, int* cscratch)
+{
+	for (;;) {
+		int32_t i = bx::atomicFetchAndAdd<int32_t>(&pool->next, 1);
+		if (i >= pool->njobs)
+			break;
+		fons__rasterizeGlyph(&pool->jobs[i], scratch, cscratch, pool->texData, pool->stride);
+	}
+}
+
+static int32_t fons__rasterThread(bx::Thread* self, void* userData)
+{
+	FONSrasterWorker* worker = (FONSrasterWorker*)userData;
+	FONSrasterPool* pool = worker->pool;
+	FONS_NOTUSED(self);
+
+	for (;;) {
+		pool->start.wait();
+		if (pool->quit)
+			break;
+		fons__runRasterJobs(pool, &worker->scratch, &worker->cscratch);
+		pool->done.post();
+	}
+	return 0;
+}
+
+static FONSrasterPool* fons__createRasterPool(void)
+{
+	int i;
+	FONSrasterPool* pool = new FONSrasterPool();
+	if (pool == NULL) return NULL;
+
+	pool->jobs = NULL;
+	pool->njobs = pool->cjobs = 0;
+	pool->next = 0;
+	pool->busy = 0;
+	pool->quit = 0;
+	for (i = 0; i < FONS_RASTER_THREADS; i++) {
+		pool->workers[i].pool = pool;
+		pool->workers[i].scratch = NULL;
+		pool->workers[i].cscratch = 0;
+		pool->workers[i].thread.init(fons__rasterThread, &pool->workers[i], 0, "fontstash");
+	}
+	return pool;
+}
+
+static void fons__deleteRasterPool(FONSrasterPool* pool)
+{
+	int i;
+	if (pool == NULL) return;
+
+	pool->quit = 1;
+	pool->start.post(FONS_RASTER_THREADS);
+	for (i = 0; i < FONS_RASTER_THREADS; i++) {
+		pool->workers[i].thread.shutdown();
+		if (pool->workers[i].scratch) free(pool->workers[i].scratch);
+	}
+	if (pool->jobs) free(pool->jobs);
+	delete pool;
+}
+
+static void fons__kickRasterJobs(FONScontext* stash)
+{
+	FONSrasterPool* pool = stash->pool;
+	FONSrasterJob* jobs;
+	int cjobs;
+
+	if (pool->busy || stash->njobs == 0)
+		return;
+
+	// Hand pending jobs over to the workers, new jobs are collected into their previous array.
+	jobs = pool->jobs;
+	cjobs = pool->cjobs;
+	pool->jobs = stash->jobs;
+	pool->cjobs = stash->cjobs;
+	pool->njobs = stash->njobs;
+	stash->jobs = jobs;
+	stash->cjobs = cjobs;
+	stash->njobs = 0;
+
+	pool->next = 0;
+	pool->texData = stash->texData;
+	pool->stride = stash->params.width;
+	pool->busy = 1;
+	pool->start.post(FONS_RASTER_THREADS);
+}
+
+static void fons__waitRasterJobs(FONScontext* stash)
+{
+	FONSrasterPool* pool = stash->pool;
+	int i;
+
+	if (!pool->busy)
+		return;
+
+	// Help with the remaining jobs and wait for the workers.
+	fons__runRasterJobs(pool, &stash->scratch, &stash->cscratch);
+	for (i = 0; i < FONS_RASTER_THREADS; i++)
+		pool->done.wait();
+	pool->busy = 0;
+}
+
+#endif // FONS_RASTER_THREADS > 0
+
+static void fons__addRasterJob(FONScontext* stash, const FONSrasterJob* job)
+{
+#if FONS_RASTER_THREADS > 0
+	if (stash->pool != NULL) {
+		if (stash->njobs+1 > stash->cjobs) {
+			int cjobs = stash->cjobs == 0 ? FONS_RASTER_BATCH : stash->cjobs * 2;
+			FONSrasterJob* jobs = (FONSrasterJob*)realloc(stash->jobs, sizeof(FONSrasterJob) * cjobs);
+			if (jobs != NULL) {
+				stash->jobs = jobs;
+				stash->cjobs = cjobs;
+			}
+		}
+		if (stash->njobs < stash->cjobs) {
+			stash->jobs[stash->njobs++] = *job;
+			// Let the workers start early on long runs of new glyphs.
+			if (stash->njobs >= FONS_RASTER_BATCH)
+				fons__kickRasterJobs(stash);
+			return;
+		}
+	}
+#endif
+	fons__rasterizeGlyph(job, &stash->scratch, &stash->cscratch, stash->texData, stash->params.width);
+}
+
+// Makes sure all glyphs added so far are rasterized into the texture data.
+static void fons__finishRasterJobs(FONScontext* stash)
+{
+#if FONS_RASTER_THREADS > 0
+	int i;
+	if (stash->pool == NULL)
+		return;
+
+	fons__waitRasterJobs(stash);
+	if (stash->njobs < FONS_RASTER_BATCH) {
+		// Not worth waking up the workers.
+		for (i = 0; i < stash->njobs; i++)
+			fons__rasterizeGlyph(&stash->jobs[i], &stash->scratch, &stash->cscratch, stash->texData, stash->params.width);
+		stash->njobs = 0;
+		return;
+	}
+	fons__kickRasterJobs(stash);
+	fons__waitRasterJobs(stash);
+#else
+	FONS_NOTUSED(stash);
+#endif
+}
+
+static FONSglyph* fons__getGlyph(FONScontext* stash, FONSfont* font, unsigned int codepoint,
+								 short isize, short iblur, int bitmapOption)
+{
+	int i, g, advance, lsb, x0, y0, x1, y1, gw, gh, gx, gy;
+	float scale;
+	FONSglyph* glyph = NULL;
+	float size = isize/10.0f;
+	int pad, added;
+	FONSrasterJob job;
+	FONSfont* renderFont = font;
+
+	if (isize < 2) return NULL;
+	if (iblur > 20) iblur = 20;
+	pad = iblur+2;
 
 	// Reset allocator.
 	stash->nscratch = 0;
 
 	// Find code point and size.
-	h = fons__hashint(codepoint) & (FONS_HASH_LUT_SIZE-1);
-	i = font->lut[h];
-	while (i != -1) {
-		if (font->glyphs[i].codepoint == codepoint && font->glyphs[i].size == isize && font->glyphs[i].blur == iblur) {
-			glyph = &font->glyphs[i];
-			if (bitmapOption == FONS_GLYPH_BITMAP_OPTIONAL || (glyph->x0 >= 0 && glyph->y0 >= 0)) {
-			  return glyph;
-			}
-			// At this point, glyph exists but the bitmap data is not yet created.
-			break;
+	i = fons__findGlyph(font, fons__glyphKey(codepoint, isize, iblur));
+	if (i != -1) {
+		glyph = &font->glyphs[i];
+		glyph->lastUsed = stash->frame;
+		if (bitmapOption == FONS_GLYPH_BITMAP_OPTIONAL || (glyph->x0 >= 0 && glyph->y0 >= 0)) {
+		  return glyph;
 		}
-		i = font->glyphs[i].next;
+		// At this point, glyph exists but the bitmap data is not yet created.
 	}
 
 	// Create a new glyph or rasterize bitmap data for a cached glyph.
@@ -1131,16 +2050,22 @@ static FONSglyph* fons__getGlyph(FONScontext* stash, FONSfont* font, unsigned in
 	// Init glyph.
 	if (glyph == NULL) {
 		glyph = fons__allocGlyph(font);
+		if (glyph == NULL) return NULL;
 		glyph->codepoint = codepoint;
 		glyph->size = isize;
 		glyph->blur = iblur;
-		glyph->next = 0;
 
-		// Insert char to hash lookup.
-		glyph->next = font->lut[h];
-		font->lut[h] = font->nglyphs-1;
+		// Insert char to hash lookup, growing it when it gets half full.
+		if (font->nglyphs*2 <= font->ctable) {
+			fons__insertGlyph(font, font->nglyphs-1);
+		} else if (!fons__rebuildGlyphTable(font)) {
+			font->nglyphs--;
+			return NULL;
+		}
+		glyph = &font->glyphs[font->nglyphs-1];
 	}
 	glyph->index = g;
+	glyph->lastUsed = stash->frame;
 	glyph->x0 = (short)gx;
 	glyph->y0 = (short)gy;
 	glyph->x1 = (short)(glyph->x0+gw);
@@ -1153,37 +2078,17 @@ static FONSglyph* fons__getGlyph(FONScontext* stash, FONSfont* font, unsigned in
 		return glyph;
 	}
 
-	// Rasterize
-	dst = &stash->texData[(glyph->x0+pad) + (glyph->y0+pad) * stash->params.width];
-	fons__tt_renderGlyphBitmap(&renderFont->font, dst, gw-pad*2,gh-pad*2, stash->params.width, scale, scale, g);
-
-	// Make sure there is one pixel empty border.
-	dst = &stash->texData[glyph->x0 + glyph->y0 * stash->params.width];
-	for (y = 0; y < gh; y++) {
-		dst[y*stash->params.width] = 0;
-		dst[gw-1 + y*stash->params.width] = 0;
-	}
-	for (x = 0; x < gw; x++) {
-		dst[x] = 0;
-		dst[x + (gh-1)*stash->params.width] = 0;
-	}
-
-	// Debug code to color the glyph background
-/*	unsigned char* fdst = &stash->texData[glyph->x0 + glyph->y0 * stash->params.width];
-	for (y = 0; y < gh; y++) {
-		for (x = 0; x < gw; x++) {
-			int a = (int)fdst[x+y*stash->params.width] + 20;
-			if (a > 255) a = 255;
-			fdst[x+y*stash->params.width] = a;
-		}
-	}*/
-
-	// Blur
-	if (iblur > 0) {
-		stash->nscratch = 0;
-		bdst = &stash->texData[glyph->x0 + glyph->y0 * stash->params.width];
-		fons__blur(stash, bdst, gw, gh, stash->params.width, iblur);
-	}
+	// Rasterize, possibly on a worker thread.
+	job.font = &renderFont->font;
+	job.glyph = g;
+	job.scale = scale;
+	job.x = glyph->x0;
+	job.y = glyph->y0;
+	job.width = (short)gw;
+	job.height = (short)gh;
+	job.pad = (short)pad;
+	job.blur = iblur;
+	fons__addRasterJob(stash, &job);
 
 	stash->dirtyRect[0] = fons__mini(stash->dirtyRect[0], glyph->x0);
 	stash->dirtyRect[1] = fons__mini(stash->dirtyRect[1], glyph->y0);
@@ -1193,6 +2098,84 @@ static FONSglyph* fons__getGlyph(FONScontext* stash, FONSfont* font, unsigned in
 	return glyph;
 }
 
+static int fons__growKernTable(FONSfont* font)
+{
+	FONSkernSlot* table;
+	int i, ckern = font->ckern == 0 ? 256 : font->ckern * 2;
+	unsigned int j, mask = (unsigned int)ckern - 1;
+
+	table = (FONSkernSlot*)malloc(sizeof(FONSkernSlot) * ckern);
+	if (table == NULL) return 0;
+	for (i = 0; i < ckern; i++)
+		table[i].key = FONS_KERN_EMPTY;
+	for (i = 0; i < font->ckern; i++) {
+		if (font->kernTable[i].key == FONS_KERN_EMPTY)
+			continue;
+		j = fons__hashKey(font->kernTable[i].key) & mask;
+		while (table[j].key != FONS_KERN_EMPTY)
+			j = (j + 1) & mask;
+		table[j] = font->kernTable[i];
+	}
+
+	free(font->kernTable);
+	font->kernTable = table;
+	font->ckern = ckern;
+	return 1;
+}
+
+// Kerning is queried for every pair of glyphs laid out, look it up in the font only once.
+static int fons__getKernAdvance(FONSfont* font, int glyph1, int glyph2)
+{
+	unsigned int i, mask, key;
+	int kern;
+
+	if (glyph1 >= 0 && glyph1 < FONS_KERN_DENSE_SIZE && glyph2 >= 0 && glyph2 < FONS_KERN_DENSE_SIZE) {
+		short* cached;
+		if (font->kernDense == NULL) {
+			font->kernDense = (short*)malloc(sizeof(short) * FONS_KERN_DENSE_SIZE * FONS_KERN_DENSE_SIZE);
+			if (font->kernDense == NULL)
+				return fons__tt_getGlyphKernAdvance(&font->font, glyph1, glyph2);
+			for (i = 0; i < FONS_KERN_DENSE_SIZE * FONS_KERN_DENSE_SIZE; i++)
+				font->kernDense[i] = SHRT_MIN;
+		}
+		cached = &font->kernDense[glyph1 * FONS_KERN_DENSE_SIZE + glyph2];
+		if (*cached == SHRT_MIN) {
+			kern = fons__tt_getGlyphKernAdvance(&font->font, glyph1, glyph2);
+			if (kern <= SHRT_MIN || kern > SHRT_MAX)
+				return kern;
+			*cached = (short)kern;
+		}
+		return *cached;
+	}
+
+	key = ((unsigned int)glyph1 << 16) | ((unsigned int)glyph2 & 0xffff);
+	if (font->kernTable != NULL) {
+		mask = (unsigned int)font->ckern - 1;
+		i = fons__hashKey(key) & mask;
+		while (font->kernTable[i].key != FONS_KERN_EMPTY) {
+			if (font->kernTable[i].key == key)
+				return font->kernTable[i].kern;
+			i = (i + 1) & mask;
+		}
+	}
+
+	kern = fons__tt_getGlyphKernAdvance(&font->font, glyph1, glyph2);
+
+	if (font->nkern >= FONS_MAX_KERN_PAIRS)
+		return kern;
+	if ((font->nkern+1)*2 > font->ckern && !fons__growKernTable(font))
+		return kern;
+	mask = (unsigned int)font->ckern - 1;
+	i = fons__hashKey(key) & mask;
+	while (font->kernTable[i].key != FONS_KERN_EMPTY)
+		i = (i + 1) & mask;
+	font->kernTable[i].key = key;
+	font->kernTable[i].kern = kern;
+	font->nkern++;
+
+	return kern;
+}
+
 static void fons__getQuad(FONScontext* stash, FONSfont* font,
 						   int prevGlyphIndex, FONSglyph* glyph,
 						   float scale, float spacing, float* x, float* y, FONSquad* q)
@@ -1200,7 +2183,7 @@ static void fons__getQuad(FONScontext* stash, FONSfont* font,
 	float rx,ry,xoff,yoff,x0,y0,x1,y1;
 
 	if (prevGlyphIndex != -1) {
-		float adv = fons__tt_getGlyphKernAdvance(&font->font, prevGlyphIndex, glyph->index) * scale;
+		float adv = fons__getKernAdvance(font, prevGlyphIndex, glyph->index) * scale;
 		*x += (int)(adv + spacing + 0.5f);
 	}
 
@@ -1247,6 +2230,8 @@ static void fons__getQuad(FONScontext* stash, FONSfont* font,
 
 static void fons__flush(FONScontext* stash)
 {
+	fons__finishRasterJobs(stash);
+
 	// Flush texture
 	if (stash->dirtyRect[0] < stash->dirtyRect[2] && stash->dirtyRect[1] < stash->dirtyRect[3]) {
 		if (stash->params.renderUpdate != NULL)
@@ -1366,6 +2351,42 @@ float fonsDrawText(FONScontext* stash,
 	return x;
 }
 
+int fonsPrewarmText(FONScontext* stash, const char* str, const char* end)
+{
+	FONSstate* state;
+	unsigned int codepoint;
+	unsigned int utf8state = 0;
+	short isize, iblur;
+	FONSfont* font;
+	int missing = 0;
+
+	if (stash == NULL) return 0;
+	state = fons__getState(stash);
+	isize = (short)(state->size*10.0f);
+	iblur = (short)state->blur;
+	if (state->font < 0 || state->font >= stash->nfonts) return 0;
+	font = stash->fonts[state->font];
+	if (font->data == NULL) return 0;
+
+	if (end == NULL)
+		end = str + strlen(str);
+
+	for (; str != end; ++str) {
+		if (fons__decutf8(&utf8state, &codepoint, *(const unsigned char*)str))
+			continue;
+		if (fons__getGlyph(stash, font, codepoint, isize, iblur, FONS_GLYPH_BITMAP_REQUIRED) == NULL)
+			missing++;
+	}
+
+#if FONS_RASTER_THREADS > 0
+	// Let the workers rasterize while the caller carries on, the jobs are joined on texture access.
+	if (stash->pool != NULL)
+		fons__kickRasterJobs(stash);
+#endif
+
+	return missing;
+}
+
 int fonsTextIterInit(FONScontext* stash, FONStextIter* iter,
 					 float x, float y, const char* str, const char* end, int bitmapOption)
 {
@@ -1440,6 +2461,219 @@ int fonsTextIterNext(FONScontext* stash, FONStextIter* iter, FONSquad* quad)
 	return 1;
 }
 
+static void fons__putOutlineSlot(FONSglyphSlot* table, int ctable, unsigned int codepoint, int offset)
+{
+	unsigned int mask = (unsigned int)ctable - 1;
+	unsigned int i = fons__hashKey(codepoint) & mask;
+	while (table[i].index != -1)
+		i = (i + 1) & mask;
+	table[i].key = codepoint;
+	table[i].index = offset;
+}
+
+static int fons__findOutline(FONSfont* font, unsigned int codepoint)
+{
+	unsigned int mask, i;
+	if (font->outlineTable == NULL) return -1;
+	mask = (unsigned int)font->coutlineTable - 1;
+	i = fons__hashKey(codepoint) & mask;
+	while (font->outlineTable[i].index != -1) {
+		if (font->outlineTable[i].key == codepoint)
+			return font->outlineTable[i].index;
+		i = (i + 1) & mask;
+	}
+	return -1;
+}
+
+static int fons__insertOutline(FONSfont* font, unsigned int codepoint, int offset)
+{
+	// Grow the lookup when it gets half full.
+	if ((font->noutlines+1)*2 > font->coutlineTable) {
+		int i, ctable = font->coutlineTable == 0 ? 64 : font->coutlineTable * 2;
+		FONSglyphSlot* table = (FONSglyphSlot*)malloc(sizeof(FONSglyphSlot) * ctable);
+		if (table == NULL) return 0;
+		for (i = 0; i < ctable; i++)
+			table[i].index = -1;
+		for (i = 0; i < font->coutlineTable; i++) {
+			if (font->outlineTable[i].index != -1)
+				fons__putOutlineSlot(table, ctable, (unsigned int)font->outlineTable[i].key, font->outlineTable[i].index);
+		}
+		if (font->outlineTable) free(font->outlineTable);
+		font->outlineTable = table;
+		font->coutlineTable = ctable;
+	}
+	fons__putOutlineSlot(font->outlineTable, font->coutlineTable, codepoint, offset);
+	font->noutlines++;
+	return 1;
+}
+
+static int fons__outlinePoints(int command)
+{
+	switch (command) {
+		case FONS_OUTLINE_MOVETO: return 1;
+		case FONS_OUTLINE_LINETO: return 1;
+		case FONS_OUTLINE_QUADTO: return 2;
+		case FONS_OUTLINE_CUBICTO: return 3;
+		default: return 0;
+	}
+}
+
+// Computes the signed area of the contour starting at 'i' from its points, including the control points,
+// which is enough to tell the winding. Returns the index past the contour.
+static int fons__contourArea(const float* commands, int i, int n, float* area)
+{
+	float x0 = 0, y0 = 0, px = 0, py = 0, a = 0;
+	while (i < n) {
+		int j, command = (int)commands[i], npts = fons__outlinePoints(command);
+		if (command == FONS_OUTLINE_CLOSE) {
+			a += px*y0 - x0*py;
+			i += 2;
+			break;
+		}
+		for (j = 0; j < npts; j++) {
+			float x = commands[i+1+j*2], y = commands[i+2+j*2];
+			if (command == FONS_OUTLINE_MOVETO) {
+				x0 = x;
+				y0 = y;
+			} else {
+				a += px*y - x*py;
+			}
+			px = x;
+			py = y;
+		}
+		i += 1 + npts*2;
+	}
+	*area = a * 0.5f;
+	return i;
+}
+
+// Returns the offset of the cached outline of the codepoint in font->outlineData, adding it when missing.
+static int fons__getOutline(FONScontext* stash, FONSfont* font, unsigned int codepoint)
+{
+	int i, j, k, n, g, start, offset;
+	float area, solid = 0, scale;
+	float* commands = NULL;
+	float* dst;
+	FONSfont* renderFont = font;
+
+	offset = fons__findOutline(font, codepoint);
+	if (offset != -1) return offset;
+
+	// Resolve the font the same way as fons__getGlyph().
+	g = fons__tt_getGlyphIndex(&font->font, codepoint);
+	if (g == 0) {
+		for (i = 0; i < font->nfallbacks; ++i) {
+			FONSfont* fallbackFont = stash->fonts[font->fallbacks[i]];
+			int fallbackIndex = fons__tt_getGlyphIndex(&fallbackFont->font, codepoint);
+			if (fallbackIndex != 0) {
+				g = fallbackIndex;
+				renderFont = fallbackFont;
+				break;
+			}
+		}
+	}
+	n = fons__tt_getGlyphOutline(&renderFont->font, g, &commands);
+	scale = fons__tt_getPixelHeightScale(&renderFont->font, 1.0f);
+
+	if (font->noutlineData+1+n > font->coutlineData) {
+		int cdata = font->coutlineData == 0 ? 4096 : font->coutlineData;
+		float* data;
+		while (font->noutlineData+1+n > cdata)
+			cdata *= 2;
+		data = (float*)realloc(font->outlineData, sizeof(float) * cdata);
+		if (data == NULL) goto error;
+		font->outlineData = data;
+		font->coutlineData = cdata;
+	}
+	offset = font->noutlineData;
+	if (!fons__insertOutline(font, codepoint, offset)) goto error;
+
+	// The contour enclosing the largest area is solid, contours wound the other way are holes.
+	for (i = 0; i < n; ) {
+		i = fons__contourArea(commands, i, n, &area);
+		if ((area < 0 ? -area : area) > (solid < 0 ? -solid : solid))
+			solid = area;
+	}
+
+	// Store in units of the font size with y down, as the glyph bitmaps.
+	font->outlineData[offset] = (float)n;
+	dst = &font->outlineData[offset+1];
+	for (i = 0; i < n; ) {
+		start = i;
+		i = fons__contourArea(commands, start, n, &area);
+		for (j = start; j < i; ) {
+			int command = (int)commands[j], npts = fons__outlinePoints(command);
+			dst[j] = commands[j];
+			if (command == FONS_OUTLINE_CLOSE) {
+				dst[j+1] = (area < 0) != (solid < 0) ? 1.0f : 0.0f;
+				j += 2;
+				continue;
+			}
+			for (k = 0; k < npts; k++) {
+				dst[j+1+k*2] = commands[j+1+k*2] * scale;
+				dst[j+2+k*2] = -commands[j+2+k*2] * scale;
+			}
+			j += 1 + npts*2;
+		}
+	}
+	font->noutlineData += 1 + n;
+
+	if (commands) free(commands);
+	return offset;
+
+error:
+	if (commands) free(commands);
+	return -1;
+}
+
+int fonsTextIterOutline(FONScontext* stash, FONStextIter* iter, const float** outline)
+{
+	FONSfont* font = iter->font;
+	float size = iter->isize / 10.0f;
+	float x, y, sy;
+	const float* src;
+	int i, j, n, offset;
+
+	*outline = NULL;
+	i = fons__findGlyph(font, fons__glyphKey(iter->codepoint, iter->isize, iter->iblur));
+	if (i == -1) return 0;
+	offset = fons__getOutline(stash, font, iter->codepoint);
+	if (offset == -1) return 0;
+	src = &font->outlineData[offset+1];
+	n = (int)font->outlineData[offset];
+	if (n == 0) return 0;
+
+	if (n > stash->coutline) {
+		float* data = (float*)realloc(stash->outline, sizeof(float) * n);
+		if (data == NULL) return 0;
+		stash->outline = data;
+		stash->coutline = n;
+	}
+
+	// The pen has already been advanced past the glyph, after kerning and spacing.
+	x = iter->nextx - (float)(int)(font->glyphs[i].xadv / 10.0f + 0.5f);
+	y = iter->nexty;
+	sy = (stash->params.flags & FONS_ZERO_TOPLEFT) ? size : -size;
+
+	for (i = 0; i < n; ) {
+		int command = (int)src[i], npts = fons__outlinePoints(command);
+		stash->outline[i] = src[i];
+		if (command == FONS_OUTLINE_CLOSE) {
+			stash->outline[i+1] = src[i+1];
+			i += 2;
+			continue;
+		}
+		for (j = 0; j < npts; j++) {
+			stash->outline[i+1+j*2] = x + src[i+1+j*2] * size;
+			stash->outline[i+2+j*2] = y + src[i+2+j*2] * sy;
+		}
+		i += 1 + npts*2;
+	}
+
+	*outline = stash->outline;
+	return n;
+}
+
 void fonsDrawDebug(FONScontext* stash, float x, float y)
 {
 	int i;
@@ -1611,6 +2845,7 @@ void fonsLineBounds(FONScontext* stash, float y, float* miny, float* maxy)
 
 const unsigned char* fonsGetTextureData(FONScontext* stash, int* width, int* height)
 {
+	fons__finishRasterJobs(stash);
 	if (width != NULL)
 		*width = stash->params.width;
 	if (height != NULL)
@@ -1620,6 +2855,7 @@ const unsigned char* fonsGetTextureData(FONScontext* stash, int* width, int* hei
 
 int fonsValidateTexture(FONScontext* stash, int* dirty)
 {
+	fons__finishRasterJobs(stash);
 	if (stash->dirtyRect[0] < stash->dirtyRect[2] && stash->dirtyRect[1] < stash->dirtyRect[3]) {
 		dirty[0] = stash->dirtyRect[0];
 		dirty[1] = stash->dirtyRect[1];
@@ -1640,16 +2876,26 @@ void fonsDeleteInternal(FONScontext* stash)
 	int i;
 	if (stash == NULL) return;
 
+#if FONS_RASTER_THREADS > 0
+	if (stash->pool) {
+		fons__waitRasterJobs(stash);
+		fons__deleteRasterPool(stash->pool);
+	}
+#endif
+
 	if (stash->params.renderDelete)
 		stash->params.renderDelete(stash->params.userPtr);
 
 	for (i = 0; i < stash->nfonts; ++i)
 		fons__freeFont(stash->fonts[i]);
+	fons__clearCachedFonts(stash);
 
 	if (stash->atlas) fons__deleteAtlas(stash->atlas);
 	if (stash->fonts) free(stash->fonts);
 	if (stash->texData) free(stash->texData);
 	if (stash->scratch) free(stash->scratch);
+	if (stash->jobs) free(stash->jobs);
+	if (stash->outline) free(stash->outline);
 	free(stash);
 	fons__tt_done(stash);
 }
@@ -1726,7 +2972,7 @@ int fonsExpandAtlas(FONScontext* stash, int width, int height)
 
 int fonsResetAtlas(FONScontext* stash, int width, int height)
 {
-	int i, j;
+	int i;
 	if (stash == NULL) return 0;
 
 	// Flush pending glyphs.
@@ -1756,20 +3002,508 @@ int fonsResetAtlas(FONScontext* stash, int width, int height)
 	for (i = 0; i < stash->nfonts; i++) {
 		FONSfont* font = stash->fonts[i];
 		font->nglyphs = 0;
-		for (j = 0; j < FONS_HASH_LUT_SIZE; j++)
-			font->lut[j] = -1;
+		fons__resetGlyphTable(font, 0);
+	}
+	fons__clearCachedFonts(stash);
+
+	stash->params.width = width;
+	stash->params.height = height;
+	stash->itw = 1.0f/stash->params.width;
+	stash->ith = 1.0f/stash->params.height;
+
+	// Add white rect at 0,0 for debug drawing.
+	fons__addWhiteRect(stash, 2,2);
+
+	return 1;
+}
+
+
+struct FONSglyphRef {
+	FONSglyph* glyph;
+	int area;
+};
+typedef struct FONSglyphRef FONSglyphRef;
+
+static int fons__cmpGlyphUsage(const void* a, const void* b)
+{
+	const FONSglyphRef* ra = (const FONSglyphRef*)a;
+	const FONSglyphRef* rb = (const FONSglyphRef*)b;
+	// Most recently used first.
+	if (ra->glyph->lastUsed != rb->glyph->lastUsed)
+		return rb->glyph->lastUsed - ra->glyph->lastUsed;
+	return rb->area - ra->area;
+}
+
+static int fons__cmpGlyphHeight(const void* a, const void* b)
+{
+	const FONSglyphRef* ra = (const FONSglyphRef*)a;
+	const FONSglyphRef* rb = (const FONSglyphRef*)b;
+	// Tallest first, packs better with the skyline.
+	return (rb->glyph->y1 - rb->glyph->y0) - (ra->glyph->y1 - ra->glyph->y0);
+}
+
+static void fons__evictGlyphs(FONScontext* stash, FONSfont* font, int maxAge)
+{
+	int i, n = 0;
+	for (i = 0; i < font->nglyphs; i++) {
+		if (stash->frame - font->glyphs[i].lastUsed <= maxAge)
+			font->glyphs[n++] = font->glyphs[i];
+	}
+	font->nglyphs = n;
+
+	// Rebuild hash lookup, it can not grow as there are fewer glyphs now.
+	fons__rebuildGlyphTable(font);
+}
+
+int fonsEvictAtlas(FONScontext* stash, int width, int height, int maxAge)
+{
+	int i, j, y, nrefs = 0, nglyphs = 0, budget;
+	int oldWidth;
+	unsigned char* oldData;
+	FONSglyphRef* refs = NULL;
+	if (stash == NULL) return 0;
+
+	// Flush pending glyphs.
+	fons__flush(stash);
+
+	// Create new texture
+	if (stash->params.renderResize != NULL) {
+		if (stash->params.renderResize(stash->params.userPtr, width, height) == 0)
+			return 0;
 	}
 
+	// Drop glyphs which have not been used recently, and collect the ones with bitmap data.
+	for (i = 0; i < stash->nfonts; i++) {
+		fons__evictGlyphs(stash, stash->fonts[i], maxAge);
+		nglyphs += stash->fonts[i]->nglyphs;
+	}
+	if (nglyphs > 0) {
+		refs = (FONSglyphRef*)malloc(sizeof(FONSglyphRef) * nglyphs);
+		if (refs == NULL) return 0;
+	}
+	for (i = 0; i < stash->nfonts; i++) {
+		FONSfont* font = stash->fonts[i];
+		for (j = 0; j < font->nglyphs; j++) {
+			FONSglyph* glyph = &font->glyphs[j];
+			if (glyph->x0 < 0 || glyph->y0 < 0)
+				continue;
+			refs[nrefs].glyph = glyph;
+			refs[nrefs].area = (glyph->x1 - glyph->x0) * (glyph->y1 - glyph->y0);
+			nrefs++;
+		}
+	}
+
+	// Keep the most recently used glyphs up to half of the new atlas,
+	// so that there is always room left for the glyph which did not fit.
+	qsort(refs, nrefs, sizeof(FONSglyphRef), fons__cmpGlyphUsage);
+	budget = width * height / 2;
+	for (i = 0; i < nrefs; i++) {
+		budget -= refs[i].area;
+		if (budget < 0)
+			break;
+	}
+	for (j = i; j < nrefs; j++) {
+		refs[j].glyph->x0 = -1;
+		refs[j].glyph->y0 = -1;
+	}
+	nrefs = i;
+	qsort(refs, nrefs, sizeof(FONSglyphRef), fons__cmpGlyphHeight);
+
+	// Swap in cleared texture data, keeping the old one to copy the glyphs from.
+	oldData = stash->texData;
+	oldWidth = stash->params.width;
+	stash->texData = (unsigned char*)malloc(width * height);
+	if (stash->texData == NULL) {
+		stash->texData = oldData;
+		if (refs) free(refs);
+		return 0;
+	}
+	memset(stash->texData, 0, width * height);
+
 	stash->params.width = width;
 	stash->params.height = height;
 	stash->itw = 1.0f/stash->params.width;
 	stash->ith = 1.0f/stash->params.height;
 
+	// Reset atlas, glyphs cached for fonts not added yet lose their place in it.
+	fons__atlasReset(stash->atlas, width, height);
+	fons__clearCachedFonts(stash);
+
+	// Reset dirty rect
+	stash->dirtyRect[0] = width;
+	stash->dirtyRect[1] = height;
+	stash->dirtyRect[2] = 0;
+	stash->dirtyRect[3] = 0;
+
 	// Add white rect at 0,0 for debug drawing.
 	fons__addWhiteRect(stash, 2,2);
 
+	// Repack kept glyphs.
+	for (i = 0; i < nrefs; i++) {
+		FONSglyph* glyph = refs[i].glyph;
+		int gw = glyph->x1 - glyph->x0;
+		int gh = glyph->y1 - glyph->y0;
+		int gx, gy;
+		if (fons__atlasAddRect(stash->atlas, gw, gh, &gx, &gy) == 0) {
+			glyph->x0 = -1;
+			glyph->y0 = -1;
+			continue;
+		}
+		for (y = 0; y < gh; y++)
+			memcpy(&stash->texData[gx + (gy+y) * width], &oldData[glyph->x0 + (glyph->y0+y) * oldWidth], gw);
+		glyph->x0 = (short)gx;
+		glyph->y0 = (short)gy;
+		glyph->x1 = (short)(gx+gw);
+		glyph->y1 = (short)(gy+gh);
+
+		stash->dirtyRect[0] = fons__mini(stash->dirtyRect[0], glyph->x0);
+		stash->dirtyRect[1] = fons__mini(stash->dirtyRect[1], glyph->y0);
+		stash->dirtyRect[2] = fons__maxi(stash->dirtyRect[2], glyph->x1);
+		stash->dirtyRect[3] = fons__maxi(stash->dirtyRect[3], glyph->y1);
+	}
+
+	free(oldData);
+	if (refs) free(refs);
+
 	return 1;
 }
 
+void fonsAdvanceFrame(FONScontext* stash)
+{
+	if (stash == NULL) return;
+	stash->frame++;
+}
+
+
+void fonsGetAtlasStats(FONScontext* stash, int maxAge, FONSatlasStats* stats)
+{
+	int i, j;
+	FONSatlas* atlas;
+	if (stash == NULL || stats == NULL) return;
+
+	atlas = stash->atlas;
+	memset(stats, 0, sizeof(FONSatlasStats));
+	stats->width = atlas->width;
+	stats->height = atlas->height;
+
+	for (i = 0; i < atlas->nnodes; i++)
+		stats->allocatedArea += atlas->nodes[i].width * atlas->nodes[i].y;
+	for (i = 0; i < atlas->nwaste; i++)
+		stats->allocatedArea -= atlas->waste[i].width * atlas->waste[i].height;
+
+	for (i = 0; i < stash->nfonts; i++) {
+		FONSfont* font = stash->fonts[i];
+		for (j = 0; j < font->nglyphs; j++) {
+			FONSglyph* glyph = &font->glyphs[j];
+			if (glyph->x0 < 0 || glyph->y0 < 0)
+				continue;
+			stats->nglyphs++;
+			if (stash->frame - glyph->lastUsed <= maxAge)
+				stats->liveArea += (glyph->x1 - glyph->x0) * (glyph->y1 - glyph->y0);
+		}
+	}
+
+	stats->occupancy = (float)stats->liveArea / (float)(atlas->width * atlas->height);
+	if (stats->allocatedArea > 0)
+		stats->fragmentation = 1.0f - (float)stats->liveArea / (float)stats->allocatedArea;
+}
+
+#define FONS_CACHE_MAGIC	0x534e4f46 // "FONS"
+#define FONS_CACHE_VERSION	2
+
+// Atlas cache file layout: header, atlas pixels, skyline nodes, reusable gaps,
+// then a FONScacheFont record followed by its glyphs for each font.
+struct FONScacheHeader {
+	unsigned int magic;
+	int version;
+	int glyphSize;	// Guards against changes of the glyph layout.
+	int width, height;
+	int nnodes, nwaste;
+	int nfonts;
+};
+typedef struct FONScacheHeader FONScacheHeader;
+
+struct FONScacheFont {
+	char name[64];
+	unsigned int key; // See fons__fontCacheKey().
+	int dataSize;
+	int nglyphs;
+};
+typedef struct FONScacheFont FONScacheFont;
+
+static int fons__writeCache(FILE* fp, const void* data, size_t size)
+{
+	return size == 0 || fwrite(data, 1, size, fp) == size;
+}
+
+static int fons__writeCacheFont(FILE* fp, const char* name, unsigned int key, int dataSize, const FONSglyph* glyphs, int nglyphs)
+{
+	FONScacheFont cfont;
+	memset(&cfont, 0, sizeof(cfont));
+	memcpy(cfont.name, name, sizeof(cfont.name));
+	cfont.key = key;
+	cfont.dataSize = dataSize;
+	cfont.nglyphs = nglyphs;
+	return fons__writeCache(fp, &cfont, sizeof(cfont)) && fons__writeCache(fp, glyphs, sizeof(FONSglyph) * nglyphs);
+}
+
+// Moves a file over another, replacing it in one step, so that readers see either file whole.
+// Processes which have the replaced file open or mapped keep reading it.
+static int fons__replaceFile(const char* from, const char* to)
+{
+#ifdef _WIN32
+	return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	return rename(from, to) == 0;
+#endif
+}
+
+static const unsigned char* fons__readCache(const unsigned char* p, const unsigned char* end, void* data, size_t size)
+{
+	if (p == NULL || (size_t)(end - p) < size) return NULL;
+	memcpy(data, p, size);
+	return p + size;
+}
+
+// New glyphs are rasterized where the skyline and the gaps say there is room,
+// so they must lie within the atlas.
+static int fons__validCacheAtlas(const FONSatlas* atlas, int width, int height)
+{
+	int i;
+	for (i = 0; i < atlas->nnodes; i++) {
+		const FONSatlasNode* node = &atlas->nodes[i];
+		if (node->x < 0 || node->width < 0 || node->x + node->width > width || node->y < 0 || node->y > height)
+			return 0;
+		if (i > 0 && node->x < atlas->nodes[i-1].x + atlas->nodes[i-1].width)
+			return 0;
+	}
+	for (i = 0; i < atlas->nwaste; i++) {
+		const FONSatlasRect* rect = &atlas->waste[i];
+		if (rect->x < 0 || rect->y < 0 || rect->width < 0 || rect->height < 0 ||
+			rect->x + rect->width > width || rect->y + rect->height > height)
+			return 0;
+	}
+	return 1;
+}
+
+static int fons__validCacheGlyph(const FONSglyph* glyph, int width, int height)
+{
+	// Glyphs without bitmap data are not in the atlas.
+	if (glyph->x0 == -1 && glyph->y0 == -1)
+		return 1;
+	return glyph->x0 >= 0 && glyph->y0 >= 0 && glyph->x0 <= glyph->x1 && glyph->y0 <= glyph->y1 &&
+		glyph->x1 <= width && glyph->y1 <= height;
+}
+
+int fonsSaveAtlasCache(FONScontext* stash, const char* path)
+{
+	FONScacheHeader header;
+	FONSatlas* atlas;
+	FILE* fp;
+	char* tmpPath;
+	size_t tmpSize;
+	int i, ok;
+
+	if (stash == NULL) return 0;
+
+	// Wait for glyphs still being rasterized.
+	fons__finishRasterJobs(stash);
+	atlas = stash->atlas;
+
+	// Write next to the cache, then replace it, as other processes may be reading it and
+	// a write cut short must not leave a truncated cache behind.
+	tmpSize = strlen(path) + 32;
+	tmpPath = (char*)malloc(tmpSize);
+	if (tmpPath == NULL) return 0;
+#ifdef _WIN32
+	snprintf(tmpPath, tmpSize, "%s.%lu.tmp", path, (unsigned long)GetCurrentProcessId());
+#else
+	snprintf(tmpPath, tmpSize, "%s.%ld.tmp", path, (long)getpid());
+#endif
+
+	fp = fopen(tmpPath, "wb");
+	if (fp == NULL) {
+		free(tmpPath);
+		return 0;
+	}
+
+	memset(&header, 0, sizeof(header));
+	header.magic = FONS_CACHE_MAGIC;
+	header.version = FONS_CACHE_VERSION;
+	header.glyphSize = (int)sizeof(FONSglyph);
+	header.width = atlas->width;
+	header.height = atlas->height;
+	header.nnodes = atlas->nnodes;
+	header.nwaste = atlas->nwaste;
+	header.nfonts = stash->nfonts + stash->ncachedFonts;
+
+	ok = fons__writeCache(fp, &header, sizeof(header));
+	ok = ok && fons__writeCache(fp, stash->texData, (size_t)atlas->width * atlas->height);
+	ok = ok && fons__writeCache(fp, atlas->nodes, sizeof(FONSatlasNode) * atlas->nnodes);
+	ok = ok && fons__writeCache(fp, atlas->waste, sizeof(FONSatlasRect) * atlas->nwaste);
+
+	for (i = 0; ok && i < stash->nfonts; i++) {
+		FONSfont* font = stash->fonts[i];
+		ok = fons__writeCacheFont(fp, font->name, fons__fontCacheKey(font->data, font->dataSize), font->dataSize, font->glyphs, font->nglyphs);
+	}
+
+	// Glyphs of fonts not added in this run still have their place in the atlas.
+	for (i = 0; ok && i < stash->ncachedFonts; i++) {
+		FONScachedFont* cached = &stash->cachedFonts[i];
+		ok = fons__writeCacheFont(fp, cached->name, cached->key, cached->dataSize, cached->glyphs, cached->nglyphs);
+	}
+
+	ok = ok && fflush(fp) == 0;
+#ifndef _WIN32
+	ok = ok && fsync(fileno(fp)) == 0;
+#endif
+	if (fclose(fp) != 0)
+		ok = 0;
+	ok = ok && fons__replaceFile(tmpPath, path);
+	if (!ok)
+		remove(tmpPath);
+	free(tmpPath);
+
+	return ok;
+}
+
+int fonsLoadAtlasCache(FONScontext* stash, const char* path)
+{
+	FONSfileMap map;
+	FONScacheHeader header;
+	FONScacheFont cfont;
+	FONSatlas* atlas;
+	const unsigned char* p;
+	const unsigned char* end;
+	int i, j, width, height, nloaded = 0;
+
+	if (stash == NULL) return 0;
+	if (!fons__mapFile(&map, path)) return 0;
+
+	width = stash->params.width;
+	height = stash->params.height;
+	end = map.data + map.size;
+
+	p = fons__readCache(map.data, end, &header, sizeof(header));
+	if (p == NULL || header.magic != FONS_CACHE_MAGIC || header.version != FONS_CACHE_VERSION ||
+		header.glyphSize != (int)sizeof(FONSglyph) || header.width <= 0 || header.height <= 0 ||
+		header.width > 0x7fff || header.height > 0x7fff || header.nnodes <= 0 || header.nwaste < 0 || header.nfonts < 0 ||
+		(size_t)(end - p) < (size_t)header.width * header.height) {
+		fons__unmapFile(&map);
+		return 0;
+	}
+
+	// Cached glyph rects are only valid in an atlas laid out exactly like the cached one.
+	if (!fonsResetAtlas(stash, header.width, header.height)) {
+		fons__unmapFile(&map);
+		return 0;
+	}
+	atlas = stash->atlas;
+
+	memcpy(stash->texData, p, (size_t)header.width * header.height);
+	p += (size_t)header.width * header.height;
+
+	if (header.nnodes > atlas->cnodes) {
+		FONSatlasNode* nodes = (FONSatlasNode*)realloc(atlas->nodes, sizeof(FONSatlasNode) * header.nnodes);
+		if (nodes == NULL) goto error;
+		atlas->nodes = nodes;
+		atlas->cnodes = header.nnodes;
+	}
+	p = fons__readCache(p, end, atlas->nodes, sizeof(FONSatlasNode) * header.nnodes);
+	if (p == NULL) goto error;
+	atlas->nnodes = header.nnodes;
+
+	if (header.nwaste > atlas->cwaste) {
+		FONSatlasRect* waste = (FONSatlasRect*)realloc(atlas->waste, sizeof(FONSatlasRect) * header.nwaste);
+		if (waste == NULL) goto error;
+		atlas->waste = waste;
+		atlas->cwaste = header.nwaste;
+	}
+	p = fons__readCache(p, end, atlas->waste, sizeof(FONSatlasRect) * header.nwaste);
+	if (p == NULL) goto error;
+	atlas->nwaste = header.nwaste;
+
+	if (!fons__validCacheAtlas(atlas, header.width, header.height))
+		goto error;
+
+	for (i = 0; i < header.nfonts; i++) {
+		const unsigned char* glyphs;
+		FONSfont* font = NULL;
+		p = fons__readCache(p, end, &cfont, sizeof(cfont));
+		if (p == NULL || cfont.nglyphs < 0 || (size_t)(end - p) / sizeof(FONSglyph) < (size_t)cfont.nglyphs)
+			goto error;
+		cfont.name[sizeof(cfont.name)-1] = '\0';
+		glyphs = p;
+		p += sizeof(FONSglyph) * cfont.nglyphs;
+
+		for (j = 0; j < cfont.nglyphs; j++) {
+			FONSglyph glyph;
+			memcpy(&glyph, glyphs + sizeof(FONSglyph) * j, sizeof(FONSglyph));
+			if (!fons__validCacheGlyph(&glyph, header.width, header.height))
+				goto error;
+		}
+		if (cfont.nglyphs == 0)
+			continue;
+
+		// Glyphs of fonts whose data changed are left out.
+		for (j = 0; j < stash->nfonts; j++) {
+			FONSfont* f = stash->fonts[j];
+			if (f->nglyphs == 0 && f->dataSize == cfont.dataSize && strcmp(f->name, cfont.name) == 0 &&
+				fons__fontCacheKey(f->data, f->dataSize) == cfont.key) {
+				font = f;
+				break;
+			}
+		}
+
+		if (font != NULL) {
+			for (j = 0; j < cfont.nglyphs; j++) {
+				FONSglyph* glyph = fons__allocGlyph(font);
+				if (glyph == NULL) goto error;
+				memcpy(glyph, glyphs + sizeof(FONSglyph) * j, sizeof(FONSglyph));
+				glyph->lastUsed = stash->frame;
+				nloaded++;
+			}
+			if (!fons__rebuildGlyphTable(font))
+				goto error;
+		} else {
+			// Fonts not added yet get their glyphs when they are, see fons__restoreCachedGlyphs().
+			FONScachedFont* cached;
+			FONScachedFont* cachedFonts = (FONScachedFont*)realloc(stash->cachedFonts, sizeof(FONScachedFont) * (stash->ncachedFonts+1));
+			if (cachedFonts == NULL) goto error;
+			stash->cachedFonts = cachedFonts;
+			cached = &stash->cachedFonts[stash->ncachedFonts];
+			cached->glyphs = (FONSglyph*)malloc(sizeof(FONSglyph) * cfont.nglyphs);
+			if (cached->glyphs == NULL) goto error;
+			memcpy(cached->name, cfont.name, sizeof(cached->name));
+			cached->key = cfont.key;
+			cached->dataSize = cfont.dataSize;
+			cached->nglyphs = cfont.nglyphs;
+			memcpy(cached->glyphs, glyphs, sizeof(FONSglyph) * cfont.nglyphs);
+			stash->ncachedFonts++;
+		}
+	}
+
+	fons__unmapFile(&map);
+
+	// Nothing usable, do not keep the space of stale glyphs.
+	if (nloaded == 0 && stash->ncachedFonts == 0) {
+		fonsResetAtlas(stash, width, height);
+		return 0;
+	}
+
+	// Upload the whole atlas.
+	stash->dirtyRect[0] = 0;
+	stash->dirtyRect[1] = 0;
+	stash->dirtyRect[2] = header.width;
+	stash->dirtyRect[3] = header.height;
+
+	return nloaded;
+
+error:
+	fons__unmapFile(&map);
+	fonsResetAtlas(stash, width, height);
+	return 0;
+}
+
 
 #endif
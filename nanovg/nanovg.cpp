@@ -20,10 +20,12 @@
 #include <stdio.h>
 #include <math.h>
 #include <memory.h>
+#include <stddef.h>
 
 #include "nanovg.h"
 
 #include <bx/bx.h>
+#include <bx/allocator.h>
 
 BX_PRAGMA_DIAGNOSTIC_IGNORED_MSVC(4701) // error C4701: potentially uninitialized local variable 'cint' used
 // -Wunused-function and 4505 must be file scope, can't be disabled between push/pop.
@@ -47,25 +49,45 @@ BX_PRAGMA_DIAGNOSTIC_POP();
 #define NVG_INIT_FONTIMAGE_SIZE  512
 #define NVG_MAX_FONTIMAGE_SIZE   2048
 #define NVG_MAX_FONTIMAGES       4
+#define NVG_MAX_GLYPH_AGE        60 // Frames a glyph survives in the atlas without being used.
+#define NVG_MAX_FONTIMAGE_FRAGMENTATION 0.5f // Glyph atlas is repacked when more of its allocated space is wasted.
+#define NVG_TEXT_CACHE_SIZE      256 // Number of cached text measurements, must be a power of two.
+#define NVG_TEXT_CACHE_MAX_LEN   256 // Longer strings are measured without caching.
+#define NVG_MIN_OUTLINE_FONT_SIZE 128.0f // Text this large in pixels is filled from glyph outlines instead of the atlas.
 
 #define NVG_INIT_COMMANDS_SIZE 256
 #define NVG_INIT_POINTS_SIZE 128
 #define NVG_INIT_PATHS_SIZE 16
 #define NVG_INIT_VERTS_SIZE 256
-#define NVG_MAX_STATES 32
+#define NVG_INIT_SAVES 32
+#define NVG_INIT_STATE_LOG_SIZE 4096
+#define NVG_MAX_BEZIER_STEPS 1024 // Most line segments a bezier curve is flattened into.
+#ifndef NVG_TESS_THREADS
+#define NVG_TESS_THREADS 3 // Worker threads tessellating deferred fills and strokes, 0 tessellates them on the calling thread.
+#endif
+#define NVG_TESS_BATCH 8 // Fewer deferred fills and strokes are tessellated on the calling thread.
+#define NVG_TESS_MAX_BATCH 64 // Deferred fills and strokes tessellated together at most.
 
 #define NVG_KAPPA90 0.5522847493f	// Length proportional to radius of a cubic bezier handle for 90deg arcs.
 
 #define NVG_COUNTOF(arr) (sizeof(arr) / sizeof(0[arr]))
 
+// Curve flattening and stroke joins are vectorized with SSE2 or 64-bit NEON, which has vector division.
+// Define NVG_NO_SIMD to use the scalar loops only.
+#if !defined(NVG_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define NVG_SIMD_SSE2 1
+#include <emmintrin.h>
+#elif !defined(NVG_NO_SIMD) && ((defined(__ARM_NEON) && defined(__aarch64__)) || defined(_M_ARM64))
+#define NVG_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if NVG_TESS_THREADS > 0
+#include <bx/cpu.h>
+#include <bx/semaphore.h>
+#include <bx/thread.h>
+#endif
 
-enum NVGcommands {
-	NVG_MOVETO = 0,
-	NVG_LINETO = 1,
-	NVG_BEZIERTO = 2,
-	NVG_CLOSE = 3,
-	NVG_WINDING = 4,
-};
 
 enum NVGpointFlags
 {
@@ -75,17 +97,27 @@ enum NVGpointFlags
 	NVG_PR_INNERBEVEL = 0x08,
 };
 
+// Kind of transform, simpler ones take cheaper paths.
+enum NVGxformClass {
+	NVG_XFORM_IDENTITY,
+	NVG_XFORM_TRANSLATE,
+	NVG_XFORM_SCALE, // Scale and translation.
+	NVG_XFORM_GENERAL,
+};
+
+// Fields are ordered by the group they are saved with, see nvg__stateGroupOffsets.
 struct NVGstate {
 	NVGcompositeOperationState compositeOperation;
 	int shapeAntiAlias;
+	float alpha;
 	NVGpaint fill;
 	NVGpaint stroke;
 	float strokeWidth;
 	float miterLimit;
 	int lineJoin;
 	int lineCap;
-	float alpha;
 	float xform[6];
+	int xformClass;
 	NVGscissor scissor;
 	float fontSize;
 	float letterSpacing;
@@ -96,6 +128,34 @@ struct NVGstate {
 };
 typedef struct NVGstate NVGstate;
 
+// Parts of the state that are saved separately when they change after nvgSave().
+enum NVGstateGroup {
+	NVG_STATE_STYLE,
+	NVG_STATE_FILL,
+	NVG_STATE_STROKE,
+	NVG_STATE_XFORM,
+	NVG_STATE_SCISSOR,
+	NVG_STATE_TEXT,
+	NVG_STATE_GROUPS,
+	NVG_STATE_ALL = (1 << NVG_STATE_GROUPS) - 1,
+};
+
+static const int nvg__stateGroupOffsets[NVG_STATE_GROUPS+1] = {
+	offsetof(NVGstate, compositeOperation),
+	offsetof(NVGstate, fill),
+	offsetof(NVGstate, stroke),
+	offsetof(NVGstate, xform),
+	offsetof(NVGstate, scissor),
+	offsetof(NVGstate, fontSize),
+	sizeof(NVGstate),
+};
+
+struct NVGsave {
+	int log; // Size of the state log when the state was saved.
+	int changed; // Groups logged since, as bits of NVGstateGroup.
+};
+typedef struct NVGsave NVGsave;
+
 struct NVGpoint {
 	float x,y;
 	float dx, dy;
@@ -119,14 +179,135 @@ struct NVGpathCache {
 };
 typedef struct NVGpathCache NVGpathCache;
 
+enum NVGdeferredType {
+	NVG_DEFERRED_FILL,
+	NVG_DEFERRED_STROKE,
+};
+
+// Fill or stroke recorded with its render state, tessellated later by whichever thread takes it.
+struct NVGdeferredCall {
+	int type;
+	NVGpaint paint;
+	NVGcompositeOperationState compositeOperation;
+	NVGscissor scissor;
+	float strokeWidth;
+	int lineCap;
+	int lineJoin;
+	float miterLimit;
+	int antiAlias;
+	int firstCommand;
+	int ncommands;
+	int sharesPath; // Draws the path of the call before it, tessellated right after it from the same points.
+	NVGdisplayList* output; // Output of the thread that tessellated the call.
+	int recorded; // Index of the call in the output, -1 when it could not be kept.
+};
+typedef struct NVGdeferredCall NVGdeferredCall;
+
+enum NVGrecordedType {
+	NVG_RECORDED_FILL,
+	NVG_RECORDED_STROKE,
+	NVG_RECORDED_TRIANGLES,
+};
+
+// Render call kept in a display list, its paths and vertices are ranges of the list.
+struct NVGrecordedCall {
+	int type;
+	NVGpaint paint;
+	NVGcompositeOperationState compositeOperation;
+	NVGscissor scissor;
+	float fringe;
+	float strokeWidth;
+	float bounds[4];
+	int firstPath;
+	int npaths;
+	int firstVert;
+	int nverts;
+};
+typedef struct NVGrecordedCall NVGrecordedCall;
+
+// Path with its vertices as offsets into the display list.
+struct NVGrecordedPath {
+	NVGpath path;
+	int fill;
+	int stroke;
+};
+typedef struct NVGrecordedPath NVGrecordedPath;
+
+struct NVGdisplayList {
+	NVGrecordedCall* calls;
+	int ncalls;
+	int ccalls;
+	NVGrecordedPath* paths;
+	int npaths;
+	int cpaths;
+	NVGvertex* verts;
+	int nverts;
+	int cverts;
+	float xform[6]; // Transform the list was recorded with.
+	int fontAtlasGeneration; // Text atlas the glyphs of the list are in, -1 without text.
+	int valid;
+	NVGdisplayList* parent; // List that was being recorded when recording of this one began.
+};
+
+enum NVGtextCacheType {
+	NVG_TEXT_CACHE_NONE = 0,
+	NVG_TEXT_CACHE_BOUNDS,
+	NVG_TEXT_CACHE_POSITIONS,
+	NVG_TEXT_CACHE_ROWS,
+};
+
+// Everything a text measurement depends on, besides the string itself.
+struct NVGtextCacheKey {
+	int type;
+	int font;
+	float size, spacing, blur, scale;
+	int align;
+	float x, y, breakRowWidth;
+	int len;
+	unsigned int hash;
+};
+typedef struct NVGtextCacheKey NVGtextCacheKey;
+
+// Cached results refer to the string by offsets, so they apply to any copy of it.
+struct NVGcachedPosition {
+	int str;
+	float x, minx, maxx;
+};
+typedef struct NVGcachedPosition NVGcachedPosition;
+
+struct NVGcachedRow {
+	int start, end, next;
+	float width, minx, maxx;
+};
+typedef struct NVGcachedRow NVGcachedRow;
+
+struct NVGtextCacheEntry {
+	NVGtextCacheKey key;
+	char str[NVG_TEXT_CACHE_MAX_LEN];
+	float width;
+	float bounds[4];
+	int count;	// Number of positions or rows.
+	int limit;	// Maximum count requested, the results are complete when count is below it.
+	void* items;
+	int citems;	// Capacity of items in bytes.
+};
+typedef struct NVGtextCacheEntry NVGtextCacheEntry;
+
 struct NVGcontext {
 	NVGparams params;
 	float* commands;
 	int ccommands;
 	int ncommands;
 	float commandx, commandy;
-	NVGstate states[NVG_MAX_STATES];
-	int nstates;
+	float* textCommands; // Glyph outlines of large text, kept apart from the path being built.
+	int ctextCommands;
+	NVGstate state;
+	NVGsave* saves;
+	int nsaves;
+	int csaves;
+	unsigned char* stateLog; // Groups as they were before changing, each followed by its NVGstateGroup.
+	int nstateLog;
+	int cstateLog;
 	NVGpathCache* cache;
 	float tessTol;
 	float distTol;
@@ -135,10 +316,35 @@ struct NVGcontext {
 	struct FONScontext* fs;
 	int fontImages[NVG_MAX_FONTIMAGES];
 	int fontImageIdx;
+	int fontImageAge;
+	float fontSizeStep;
+	NVGtextCacheEntry* textCache;
+	int textCacheHits;
+	int textCacheMisses;
 	int drawCallCount;
 	int fillTriCount;
 	int strokeTriCount;
 	int textTriCount;
+	int shapeCount; // Fills and strokes drawn this frame.
+	int culledShapeCount; // Fills and strokes skipped this frame for being out of view.
+	float viewWidth;
+	float viewHeight;
+	int deferTessellation;
+	NVGdeferredCall* deferred; // Fills and strokes waiting to be tessellated, in drawing order.
+	int ndeferred;
+	int cdeferred;
+	float* deferredCommands; // Path commands of the deferred calls.
+	int ndeferredCommands;
+	int cdeferredCommands;
+	int deferredPath; // Deferred call the current path was last drawn by, -1 when there is none.
+	NVGcontext* tess; // Tessellates deferred calls on the calling thread.
+	struct NVGtessPool* tessPool;
+	NVGdisplayList* recording;
+	int fontAtlasGeneration; // Changes whenever glyphs may have moved in the text atlas.
+	NVGvertex* replayVerts; // Transformed vertices and paths of the display list being replayed.
+	int creplayVerts;
+	NVGpath* replayPaths;
+	int creplayPaths;
 };
 
 static float nvg__sqrtf(float a) { return sqrtf(a); }
@@ -170,40 +376,163 @@ static float nvg__normalize(float *x, float* y)
 	return d;
 }
 
+#if defined(NVG_SIMD_SSE2) || defined(NVG_SIMD_NEON)
+
+// Four floats processed at once, one lane per curve point or path point.
+#ifdef NVG_SIMD_SSE2
+
+typedef __m128 NVGlanes;
+
+static NVGlanes nvg__lanesSplat(float a) { return _mm_set1_ps(a); }
+static NVGlanes nvg__lanesSet(float a, float b, float c, float d) { return _mm_setr_ps(a, b, c, d); }
+static NVGlanes nvg__lanesAdd(NVGlanes a, NVGlanes b) { return _mm_add_ps(a, b); }
+static NVGlanes nvg__lanesSub(NVGlanes a, NVGlanes b) { return _mm_sub_ps(a, b); }
+static NVGlanes nvg__lanesMul(NVGlanes a, NVGlanes b) { return _mm_mul_ps(a, b); }
+static NVGlanes nvg__lanesDiv(NVGlanes a, NVGlanes b) { return _mm_div_ps(a, b); }
+static NVGlanes nvg__lanesMin(NVGlanes a, NVGlanes b) { return _mm_min_ps(a, b); }
+static NVGlanes nvg__lanesMax(NVGlanes a, NVGlanes b) { return _mm_max_ps(a, b); }
+static NVGlanes nvg__lanesLoad(const float* p) { return _mm_loadu_ps(p); }
+static void nvg__lanesStore(float* p, NVGlanes a) { _mm_storeu_ps(p, a); }
+
+static NVGlanes nvg__lanesAnd(NVGlanes a, NVGlanes b) { return _mm_and_ps(a, b); }
+static NVGlanes nvg__lanesOr(NVGlanes a, NVGlanes b) { return _mm_or_ps(a, b); }
+
+// Lanes holding the bits of an integer.
+static NVGlanes nvg__lanesBits(int a) { return _mm_castsi128_ps(_mm_set1_epi32(a)); }
+
+// Mask with all bits set in the lanes where a is less than b.
+static NVGlanes nvg__lanesLess(NVGlanes a, NVGlanes b) { return _mm_cmplt_ps(a, b); }
+
+// Mask of the lanes of a having all of the given bits set.
+static NVGlanes nvg__lanesHasBits(NVGlanes a, int bits)
+{
+	__m128i b = _mm_set1_epi32(bits);
+	return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_castps_si128(a), b), b));
+}
+
+// Bit i is set when lane i of the mask is.
+static int nvg__lanesMask(NVGlanes m) { return _mm_movemask_ps(m); }
+
+// Lanes of x where a is greater than b, lanes of y elsewhere.
+static NVGlanes nvg__lanesSelectGreater(NVGlanes a, NVGlanes b, NVGlanes x, NVGlanes y)
+{
+	__m128 m = _mm_cmpgt_ps(a, b);
+	return _mm_or_ps(_mm_and_ps(m, x), _mm_andnot_ps(m, y));
+}
+
+// Lane 3 of a followed by lanes 0 to 2 of b.
+static NVGlanes nvg__lanesShift(NVGlanes a, NVGlanes b)
+{
+	__m128 t = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 3, 3));
+	return _mm_shuffle_ps(t, b, _MM_SHUFFLE(2, 1, 2, 0));
+}
+
+static void nvg__lanesTranspose(NVGlanes* a, NVGlanes* b, NVGlanes* c, NVGlanes* d)
+{
+	__m128 r0 = *a, r1 = *b, r2 = *c, r3 = *d;
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+	*a = r0; *b = r1; *c = r2; *d = r3;
+}
+
+#else
+
+typedef float32x4_t NVGlanes;
+
+static NVGlanes nvg__lanesSplat(float a) { return vdupq_n_f32(a); }
+static NVGlanes nvg__lanesSet(float a, float b, float c, float d) { float v[4] = { a, b, c, d }; return vld1q_f32(v); }
+static NVGlanes nvg__lanesAdd(NVGlanes a, NVGlanes b) { return vaddq_f32(a, b); }
+static NVGlanes nvg__lanesSub(NVGlanes a, NVGlanes b) { return vsubq_f32(a, b); }
+static NVGlanes nvg__lanesMul(NVGlanes a, NVGlanes b) { return vmulq_f32(a, b); }
+static NVGlanes nvg__lanesDiv(NVGlanes a, NVGlanes b) { return vdivq_f32(a, b); }
+static NVGlanes nvg__lanesMin(NVGlanes a, NVGlanes b) { return vminq_f32(a, b); }
+static NVGlanes nvg__lanesMax(NVGlanes a, NVGlanes b) { return vmaxq_f32(a, b); }
+static NVGlanes nvg__lanesLoad(const float* p) { return vld1q_f32(p); }
+static void nvg__lanesStore(float* p, NVGlanes a) { vst1q_f32(p, a); }
+
+static NVGlanes nvg__lanesAnd(NVGlanes a, NVGlanes b) { return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b))); }
+static NVGlanes nvg__lanesOr(NVGlanes a, NVGlanes b) { return vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b))); }
+static NVGlanes nvg__lanesBits(int a) { return vreinterpretq_f32_u32(vdupq_n_u32((uint32_t)a)); }
+static NVGlanes nvg__lanesLess(NVGlanes a, NVGlanes b) { return vreinterpretq_f32_u32(vcltq_f32(a, b)); }
+
+static NVGlanes nvg__lanesHasBits(NVGlanes a, int bits)
+{
+	uint32x4_t b = vdupq_n_u32((uint32_t)bits);
+	return vreinterpretq_f32_u32(vceqq_u32(vandq_u32(vreinterpretq_u32_f32(a), b), b));
+}
+
+static int nvg__lanesMask(NVGlanes m)
+{
+	uint32x4_t u = vreinterpretq_u32_f32(m);
+	return (int)((vgetq_lane_u32(u, 0) & 1) | (vgetq_lane_u32(u, 1) & 2) | (vgetq_lane_u32(u, 2) & 4) | (vgetq_lane_u32(u, 3) & 8));
+}
+
+static NVGlanes nvg__lanesSelectGreater(NVGlanes a, NVGlanes b, NVGlanes x, NVGlanes y)
+{
+	return vbslq_f32(vcgtq_f32(a, b), x, y);
+}
+
+static NVGlanes nvg__lanesShift(NVGlanes a, NVGlanes b) { return vextq_f32(a, b, 3); }
+
+static void nvg__lanesTranspose(NVGlanes* a, NVGlanes* b, NVGlanes* c, NVGlanes* d)
+{
+	float32x4x2_t ab = vzipq_f32(*a, *b);
+	float32x4x2_t cd = vzipq_f32(*c, *d);
+	*a = vcombine_f32(vget_low_f32(ab.val[0]), vget_low_f32(cd.val[0]));
+	*b = vcombine_f32(vget_high_f32(ab.val[0]), vget_high_f32(cd.val[0]));
+	*c = vcombine_f32(vget_low_f32(ab.val[1]), vget_low_f32(cd.val[1]));
+	*d = vcombine_f32(vget_high_f32(ab.val[1]), vget_high_f32(cd.val[1]));
+}
+
+#endif // NVG_SIMD_SSE2
+
+// Lanes from four consecutive structures, stride floats apart.
+static NVGlanes nvg__lanesGather(const float* p, int stride)
+{
+	return nvg__lanesSet(p[0], p[stride], p[2*stride], p[3*stride]);
+}
+
+#endif // NVG_SIMD_SSE2 || NVG_SIMD_NEON
+
+
+static bx::AllocatorI* nvg__defaultAllocator(void)
+{
+	static bx::DefaultAllocator allocator;
+	return &allocator;
+}
 
-static void nvg__deletePathCache(NVGpathCache* c)
+static void nvg__deletePathCache(bx::AllocatorI* allocator, NVGpathCache* c)
 {
 	if (c == NULL) return;
-	if (c->points != NULL) free(c->points);
-	if (c->paths != NULL) free(c->paths);
-	if (c->verts != NULL) free(c->verts);
-	free(c);
+	if (c->points != NULL) BX_FREE(allocator, c->points);
+	if (c->paths != NULL) BX_FREE(allocator, c->paths);
+	if (c->verts != NULL) BX_FREE(allocator, c->verts);
+	BX_FREE(allocator, c);
 }
 
-static NVGpathCache* nvg__allocPathCache(void)
+static NVGpathCache* nvg__allocPathCache(bx::AllocatorI* allocator)
 {
-	NVGpathCache* c = (NVGpathCache*)malloc(sizeof(NVGpathCache));
+	NVGpathCache* c = (NVGpathCache*)BX_ALLOC(allocator, sizeof(NVGpathCache));
 	if (c == NULL) goto error;
 	memset(c, 0, sizeof(NVGpathCache));
 
-	c->points = (NVGpoint*)malloc(sizeof(NVGpoint)*NVG_INIT_POINTS_SIZE);
+	c->points = (NVGpoint*)BX_ALLOC(allocator, sizeof(NVGpoint)*NVG_INIT_POINTS_SIZE);
 	if (!c->points) goto error;
 	c->npoints = 0;
 	c->cpoints = NVG_INIT_POINTS_SIZE;
 
-	c->paths = (NVGpath*)malloc(sizeof(NVGpath)*NVG_INIT_PATHS_SIZE);
+	c->paths = (NVGpath*)BX_ALLOC(allocator, sizeof(NVGpath)*NVG_INIT_PATHS_SIZE);
 	if (!c->paths) goto error;
 	c->npaths = 0;
 	c->cpaths = NVG_INIT_PATHS_SIZE;
 
-	c->verts = (NVGvertex*)malloc(sizeof(NVGvertex)*NVG_INIT_VERTS_SIZE);
+	c->verts = (NVGvertex*)BX_ALLOC(allocator, sizeof(NVGvertex)*NVG_INIT_VERTS_SIZE);
 	if (!c->verts) goto error;
 	c->nverts = 0;
 	c->cverts = NVG_INIT_VERTS_SIZE;
 
 	return c;
 error:
-	nvg__deletePathCache(c);
+	nvg__deletePathCache(allocator, c);
 	return NULL;
 }
 
@@ -290,28 +619,73 @@ static NVGcompositeOperationState nvg__compositeOperationState(int op)
 
 static NVGstate* nvg__getState(NVGcontext* ctx)
 {
-	return &ctx->states[ctx->nstates-1];
+	return &ctx->state;
+}
+
+// Returns the state for changing the given groups, logging what they were
+// before if it is their first change since the last nvgSave().
+static NVGstate* nvg__editState(NVGcontext* ctx, int groups)
+{
+	NVGsave* save;
+	int i;
+
+	// The state of the frame is not restored.
+	if (ctx->nsaves <= 1)
+		return &ctx->state;
+
+	save = &ctx->saves[ctx->nsaves-1];
+	groups &= ~save->changed;
+	for (i = 0; groups != 0; i++, groups >>= 1) {
+		int offset = nvg__stateGroupOffsets[i];
+		int size = nvg__stateGroupOffsets[i+1] - offset;
+		if ((groups & 1) == 0) continue;
+		if (ctx->nstateLog+size+(int)sizeof(int) > ctx->cstateLog) {
+			int cstateLog = nvg__maxi(ctx->nstateLog+size+(int)sizeof(int), ctx->cstateLog*2);
+			unsigned char* stateLog = (unsigned char*)BX_REALLOC(ctx->params.allocator, ctx->stateLog, cstateLog);
+			if (stateLog == NULL) break; // The change is kept on restore.
+			ctx->stateLog = stateLog;
+			ctx->cstateLog = cstateLog;
+		}
+		memcpy(&ctx->stateLog[ctx->nstateLog], (unsigned char*)&ctx->state + offset, size);
+		memcpy(&ctx->stateLog[ctx->nstateLog+size], &i, sizeof(int));
+		ctx->nstateLog += size + sizeof(int);
+		save->changed |= 1 << i;
+	}
+	return &ctx->state;
 }
 
 NVGcontext* nvgCreateInternal(NVGparams* params)
 {
 	FONSparams fontParams;
-	NVGcontext* ctx = (NVGcontext*)malloc(sizeof(NVGcontext));
+	bx::AllocatorI* allocator = params->allocator != NULL ? params->allocator : nvg__defaultAllocator();
+	NVGcontext* ctx = (NVGcontext*)BX_ALLOC(allocator, sizeof(NVGcontext));
 	int i;
 	if (ctx == NULL) goto error;
 	memset(ctx, 0, sizeof(NVGcontext));
 
 	ctx->params = *params;
+	ctx->params.allocator = allocator;
 	for (i = 0; i < NVG_MAX_FONTIMAGES; i++)
 		ctx->fontImages[i] = 0;
 
-	ctx->commands = (float*)malloc(sizeof(float)*NVG_INIT_COMMANDS_SIZE);
+	ctx->commands = (float*)BX_ALLOC(allocator, sizeof(float)*NVG_INIT_COMMANDS_SIZE);
 	if (!ctx->commands) goto error;
 	ctx->ncommands = 0;
 	ctx->ccommands = NVG_INIT_COMMANDS_SIZE;
 
-	ctx->cache = nvg__allocPathCache();
+	ctx->cache = nvg__allocPathCache(allocator);
 	if (ctx->cache == NULL) goto error;
+	ctx->deferredPath = -1;
+
+	ctx->saves = (NVGsave*)BX_ALLOC(allocator, sizeof(NVGsave)*NVG_INIT_SAVES);
+	if (!ctx->saves) goto error;
+	ctx->nsaves = 0;
+	ctx->csaves = NVG_INIT_SAVES;
+
+	ctx->stateLog = (unsigned char*)BX_ALLOC(allocator, NVG_INIT_STATE_LOG_SIZE);
+	if (!ctx->stateLog) goto error;
+	ctx->nstateLog = 0;
+	ctx->cstateLog = NVG_INIT_STATE_LOG_SIZE;
 
 	nvgSave(ctx);
 	nvgReset(ctx);
@@ -350,16 +724,32 @@ NVGparams* nvgInternalParams(NVGcontext* ctx)
 	return &ctx->params;
 }
 
+static void nvg__deleteDeferred(NVGcontext* ctx);
+
 void nvgDeleteInternal(NVGcontext* ctx)
 {
+	bx::AllocatorI* allocator;
 	int i;
 	if (ctx == NULL) return;
-	if (ctx->commands != NULL) free(ctx->commands);
-	if (ctx->cache != NULL) nvg__deletePathCache(ctx->cache);
+	allocator = ctx->params.allocator;
+	if (ctx->commands != NULL) BX_FREE(allocator, ctx->commands);
+	if (ctx->saves != NULL) BX_FREE(allocator, ctx->saves);
+	if (ctx->stateLog != NULL) BX_FREE(allocator, ctx->stateLog);
+	if (ctx->textCommands != NULL) BX_FREE(allocator, ctx->textCommands);
+	if (ctx->replayVerts != NULL) BX_FREE(allocator, ctx->replayVerts);
+	if (ctx->replayPaths != NULL) BX_FREE(allocator, ctx->replayPaths);
+	if (ctx->cache != NULL) nvg__deletePathCache(allocator, ctx->cache);
+	nvg__deleteDeferred(ctx);
 
 	if (ctx->fs)
 		fonsDeleteInternal(ctx->fs);
 
+	if (ctx->textCache != NULL) {
+		for (i = 0; i < NVG_TEXT_CACHE_SIZE; i++)
+			BX_FREE(allocator, ctx->textCache[i].items);
+		BX_FREE(allocator, ctx->textCache);
+	}
+
 	for (i = 0; i < NVG_MAX_FONTIMAGES; i++) {
 		if (ctx->fontImages[i] != 0) {
 			nvgDeleteImage(ctx, ctx->fontImages[i]);
@@ -370,7 +760,7 @@ void nvgDeleteInternal(NVGcontext* ctx)
 	if (ctx->params.renderDelete != NULL)
 		ctx->params.renderDelete(ctx->params.userPtr);
 
-	free(ctx);
+	BX_FREE(allocator, ctx);
 }
 
 void nvgBeginFrame(NVGcontext* ctx, float windowWidth, float windowHeight, float devicePixelRatio)
@@ -379,27 +769,54 @@ void nvgBeginFrame(NVGcontext* ctx, float windowWidth, float windowHeight, float
 		ctx->drawCallCount, ctx->fillTriCount, ctx->strokeTriCount, ctx->textTriCount,
 		ctx->fillTriCount+ctx->strokeTriCount+ctx->textTriCount);*/
 
-	ctx->nstates = 0;
+	ctx->nsaves = 0;
+	ctx->nstateLog = 0;
 	nvgSave(ctx);
 	nvgReset(ctx);
 
+	// Drop calls left over from a frame that was not ended.
+	ctx->ndeferred = 0;
+	ctx->ndeferredCommands = 0;
+	ctx->deferredPath = -1;
+	while (ctx->recording != NULL) {
+		ctx->recording->valid = 0;
+		ctx->recording = ctx->recording->parent;
+	}
+
 	nvg__setDevicePixelRatio(ctx, devicePixelRatio);
 
+	fonsAdvanceFrame(ctx->fs);
+
 	ctx->params.renderViewport(ctx->params.userPtr, windowWidth, windowHeight, devicePixelRatio);
+	ctx->viewWidth = windowWidth;
+	ctx->viewHeight = windowHeight;
 
 	ctx->drawCallCount = 0;
 	ctx->fillTriCount = 0;
 	ctx->strokeTriCount = 0;
 	ctx->textTriCount = 0;
+	ctx->shapeCount = 0;
+	ctx->culledShapeCount = 0;
 }
 
 void nvgCancelFrame(NVGcontext* ctx)
 {
+	ctx->ndeferred = 0;
+	ctx->ndeferredCommands = 0;
+	ctx->deferredPath = -1;
+	while (ctx->recording != NULL) {
+		ctx->recording->valid = 0;
+		ctx->recording = ctx->recording->parent;
+	}
 	ctx->params.renderCancel(ctx->params.userPtr);
 }
 
+static void nvg__compactTextAtlas(NVGcontext* ctx);
+static void nvg__flushDeferred(NVGcontext* ctx);
+
 void nvgEndFrame(NVGcontext* ctx)
 {
+	nvg__flushDeferred(ctx);
 	ctx->params.renderFlush(ctx->params.userPtr);
 	if (ctx->fontImageIdx != 0) {
 		int fontImage = ctx->fontImages[ctx->fontImageIdx];
@@ -426,6 +843,11 @@ void nvgEndFrame(NVGcontext* ctx)
 		for (i = j; i < NVG_MAX_FONTIMAGES; i++)
 			ctx->fontImages[i] = 0;
 	}
+	// check glyph atlas usage once per glyph lifetime
+	if (++ctx->fontImageAge >= NVG_MAX_GLYPH_AGE) {
+		ctx->fontImageAge = 0;
+		nvg__compactTextAtlas(ctx);
+	}
 }
 
 NVGcolor nvgRGB(unsigned char r, unsigned char g, unsigned char b)
@@ -610,6 +1032,26 @@ void nvgTransformPoint(float* dx, float* dy, const float* t, float sx, float sy)
 	*dy = sx*t[1] + sy*t[3] + t[5];
 }
 
+static int nvg__classifyXform(const float* t)
+{
+	if (t[1] != 0.0f || t[2] != 0.0f)
+		return NVG_XFORM_GENERAL;
+	if (t[0] != 1.0f || t[3] != 1.0f)
+		return NVG_XFORM_SCALE;
+	if (t[4] != 0.0f || t[5] != 0.0f)
+		return NVG_XFORM_TRANSLATE;
+	return NVG_XFORM_IDENTITY;
+}
+
+static void nvg__inverseStateXform(float* inv, const NVGstate* state)
+{
+	if (state->xformClass <= NVG_XFORM_TRANSLATE) {
+		nvgTransformTranslate(inv, -state->xform[4], -state->xform[5]);
+		return;
+	}
+	nvgTransformInverse(inv, state->xform);
+}
+
 float nvgDegToRad(float deg)
 {
 	return deg / 180.0f * NVG_PI;
@@ -634,23 +1076,39 @@ static void nvg__setPaintColor(NVGpaint* p, NVGcolor color)
 // State handling
 void nvgSave(NVGcontext* ctx)
 {
-	if (ctx->nstates >= NVG_MAX_STATES)
-		return;
-	if (ctx->nstates > 0)
-		memcpy(&ctx->states[ctx->nstates], &ctx->states[ctx->nstates-1], sizeof(NVGstate));
-	ctx->nstates++;
+	NVGsave* save;
+	if (ctx->nsaves >= ctx->csaves) {
+		int csaves = ctx->csaves * 2;
+		NVGsave* saves = (NVGsave*)BX_REALLOC(ctx->params.allocator, ctx->saves, sizeof(NVGsave)*csaves);
+		if (saves == NULL) return;
+		ctx->saves = saves;
+		ctx->csaves = csaves;
+	}
+	// Groups of the state are logged when they first change after the save.
+	save = &ctx->saves[ctx->nsaves++];
+	save->log = ctx->nstateLog;
+	save->changed = 0;
 }
 
 void nvgRestore(NVGcontext* ctx)
 {
-	if (ctx->nstates <= 1)
+	NVGsave* save;
+	if (ctx->nsaves <= 1)
 		return;
-	ctx->nstates--;
+	save = &ctx->saves[--ctx->nsaves];
+	while (ctx->nstateLog > save->log) {
+		int group, offset, size;
+		memcpy(&group, &ctx->stateLog[ctx->nstateLog-sizeof(int)], sizeof(int));
+		offset = nvg__stateGroupOffsets[group];
+		size = nvg__stateGroupOffsets[group+1] - offset;
+		ctx->nstateLog -= size + sizeof(int);
+		memcpy((unsigned char*)&ctx->state + offset, &ctx->stateLog[ctx->nstateLog], size);
+	}
 }
 
 void nvgReset(NVGcontext* ctx)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__editState(ctx, NVG_STATE_ALL);
 	memset(state, 0, sizeof(*state));
 
 	nvg__setPaintColor(&state->fill, nvgRGBA(255,255,255,255));
@@ -678,89 +1136,111 @@ void nvgReset(NVGcontext* ctx)
 // State setting
 void nvgShapeAntiAlias(NVGcontext* ctx, int enabled)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__editState(ctx, 1 << NVG_STATE_STYLE);
 	state->shapeAntiAlias = enabled;
 }
 
 void nvgStrokeWidth(NVGcontext* ctx, float width)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__editState(ctx, 1 << NVG_STATE_STROKE);
 	state->strokeWidth = width;
 }
 
 void nvgMiterLimit(NVGcontext* ctx, float limit)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__editState(ctx, 1 << NVG_STATE_STROKE);
 	state->miterLimit = limit;
 }
 
 void nvgLineCap(NVGcontext* ctx, int cap)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__editState(ctx, 1 << NVG_STATE_STROKE);
 	state->lineCap = cap;
 }
 
 void nvgLineJoin(NVGcontext* ctx, int join)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__editState(ctx, 1 << NVG_STATE_STROKE);
 	state->lineJoin = join;
 }
 
 void nvgGlobalAlpha(NVGcontext* ctx, float alpha)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__editState(ctx, 1 << NVG_STATE_STYLE);
 	state->alpha = alpha;
 }
 
+float nvgCurrentGlobalAlpha(NVGcontext* ctx)
+{
+	return nvg__getState(ctx)->alpha;
+}
+
 void nvgTransform(NVGcontext* ctx, float a, float b, float c, float d, float e, float f)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__editState(ctx, 1 << NVG_STATE_XFORM);
 	float t[6] = { a, b, c, d, e, f };
 	nvgTransformPremultiply(state->xform, t);
+	state->xformClass = nvg__classifyXform(state->xform);
 }
 
 void nvgResetTransform(NVGcontext* ctx)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__editState(ctx, 1 << NVG_STATE_XFORM);
 	nvgTransformIdentity(state->xform);
+	state->xformClass = NVG_XFORM_IDENTITY;
 }
 
 void nvgTranslate(NVGcontext* ctx, float x, float y)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__editState(ctx, 1 << NVG_STATE_XFORM);
 	float t[6];
+	if (state->xformClass <= NVG_XFORM_TRANSLATE) {
+		state->xform[4] += x;
+		state->xform[5] += y;
+		state->xformClass = nvg__classifyXform(state->xform);
+		return;
+	}
 	nvgTransformTranslate(t, x,y);
 	nvgTransformPremultiply(state->xform, t);
 }
 
 void nvgRotate(NVGcontext* ctx, float angle)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__editState(ctx, 1 << NVG_STATE_XFORM);
 	float t[6];
 	nvgTransformRotate(t, angle);
 	nvgTransformPremultiply(state->xform, t);
+	state->xformClass = nvg__classifyXform(state->xform);
 }
 
 void nvgSkewX(NVGcontext* ctx, float angle)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__editState(ctx, 1 << NVG_STATE_XFORM);
 	float t[6];
 	nvgTransformSkewX(t, angle);
 	nvgTransformPremultiply(state->xform, t);
+	state->xformClass = nvg__classifyXform(state->xform);
 }
 
 void nvgSkewY(NVGcontext* ctx, float angle)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__editState(ctx, 1 << NVG_STATE_XFORM);
 	float t[6];
 	nvgTransformSkewY(t, angle);
 	nvgTransformPremultiply(state->xform, t);
+	state->xformClass = nvg__classifyXform(state->xform);
 }
 
 void nvgScale(NVGcontext* ctx, float x, float y)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__editState(ctx, 1 << NVG_STATE_XFORM);
 	float t[6];
+	if (state->xformClass <= NVG_XFORM_SCALE) {
+		state->xform[0] *= x;
+		state->xform[3] *= y;
+		state->xformClass = nvg__classifyXform(state->xform);
+		return;
+	}
 	nvgTransformScale(t, x,y);
 	nvgTransformPremultiply(state->xform, t);
 }
@@ -774,26 +1254,26 @@ void nvgCurrentTransform(NVGcontext* ctx, float* xform)
 
 void nvgStrokeColor(NVGcontext* ctx, NVGcolor color)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__editState(ctx, 1 << NVG_STATE_STROKE);
 	nvg__setPaintColor(&state->stroke, color);
 }
 
 void nvgStrokePaint(NVGcontext* ctx, NVGpaint paint)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__editState(ctx, 1 << NVG_STATE_STROKE);
 	state->stroke = paint;
 	nvgTransformMultiply(state->stroke.xform, state->xform);
 }
 
 void nvgFillColor(NVGcontext* ctx, NVGcolor color)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__editState(ctx, 1 << NVG_STATE_FILL);
 	nvg__setPaintColor(&state->fill, color);
 }
 
 void nvgFillPaint(NVGcontext* ctx, NVGpaint paint)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__editState(ctx, 1 << NVG_STATE_FILL);
 	state->fill = paint;
 	nvgTransformMultiply(state->fill.xform, state->xform);
 }
@@ -806,6 +1286,7 @@ int nvgCreateImageRGBA(NVGcontext* ctx, int w, int h, int imageFlags, const unsi
 void nvgUpdateImage(NVGcontext* ctx, int image, const unsigned char* data)
 {
 	int w, h;
+	nvg__flushDeferred(ctx);
 	ctx->params.renderGetTextureSize(ctx->params.userPtr, image, &w, &h);
 	ctx->params.renderUpdateTexture(ctx->params.userPtr, image, 0,0, w,h, data);
 }
@@ -817,6 +1298,7 @@ void nvgImageSize(NVGcontext* ctx, int image, int* w, int* h)
 
 void nvgDeleteImage(NVGcontext* ctx, int image)
 {
+	nvg__flushDeferred(ctx);
 	ctx->params.renderDeleteTexture(ctx->params.userPtr, image);
 }
 
@@ -937,7 +1419,7 @@ NVGpaint nvgImagePattern(NVGcontext* ctx,
 // Scissoring
 void nvgScissor(NVGcontext* ctx, float x, float y, float w, float h)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__editState(ctx, 1 << NVG_STATE_SCISSOR);
 
 	w = nvg__maxf(0.0f, w);
 	h = nvg__maxf(0.0f, h);
@@ -983,7 +1465,7 @@ void nvgIntersectScissor(NVGcontext* ctx, float x, float y, float w, float h)
 	memcpy(pxform, state->scissor.xform, sizeof(float)*6);
 	ex = state->scissor.extent[0];
 	ey = state->scissor.extent[1];
-	nvgTransformInverse(invxorm, state->xform);
+	nvg__inverseStateXform(invxorm, state);
 	nvgTransformMultiply(pxform, invxorm);
 	tex = ex*nvg__absf(pxform[0]) + ey*nvg__absf(pxform[2]);
 	tey = ex*nvg__absf(pxform[1]) + ey*nvg__absf(pxform[3]);
@@ -1010,7 +1492,7 @@ void nvgCurrentScissor(NVGcontext* ctx, float* x, float* y, float* w, float* h)
     memcpy(pxform, state->scissor.xform, sizeof(float)*6);
     ex = state->scissor.extent[0];
     ey = state->scissor.extent[1];
-    nvgTransformInverse(invxorm, state->xform);
+    nvg__inverseStateXform(invxorm, state);
     nvgTransformMultiply(pxform, invxorm);
     tex = ex*nvg__absf(pxform[0]) + ey*nvg__absf(pxform[2]);
     tey = ex*nvg__absf(pxform[1]) + ey*nvg__absf(pxform[3]);
@@ -1023,7 +1505,7 @@ void nvgCurrentScissor(NVGcontext* ctx, float* x, float* y, float* w, float* h)
 
 void nvgResetScissor(NVGcontext* ctx)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__editState(ctx, 1 << NVG_STATE_SCISSOR);
 	memset(state->scissor.xform, 0, sizeof(state->scissor.xform));
 	state->scissor.extent[0] = -1.0f;
 	state->scissor.extent[1] = -1.0f;
@@ -1032,7 +1514,7 @@ void nvgResetScissor(NVGcontext* ctx)
 // Global composite operation.
 void nvgGlobalCompositeOperation(NVGcontext* ctx, int op)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__editState(ctx, 1 << NVG_STATE_STYLE);
 	state->compositeOperation = nvg__compositeOperationState(op);
 }
 
@@ -1049,7 +1531,7 @@ void nvgGlobalCompositeBlendFuncSeparate(NVGcontext* ctx, int srcRGB, int dstRGB
 	op.srcAlpha = srcAlpha;
 	op.dstAlpha = dstAlpha;
 
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__editState(ctx, 1 << NVG_STATE_STYLE);
 	state->compositeOperation = op;
 }
 
@@ -1085,7 +1567,7 @@ static void nvg__appendCommands(NVGcontext* ctx, float* vals, int nvals)
 	if (ctx->ncommands+nvals > ctx->ccommands) {
 		float* commands;
 		int ccommands = ctx->ncommands+nvals + ctx->ccommands/2;
-		commands = (float*)realloc(ctx->commands, sizeof(float)*ccommands);
+		commands = (float*)BX_REALLOC(ctx->params.allocator, ctx->commands, sizeof(float)*ccommands);
 		if (commands == NULL) return;
 		ctx->commands = commands;
 		ctx->ccommands = ccommands;
@@ -1096,8 +1578,8 @@ static void nvg__appendCommands(NVGcontext* ctx, float* vals, int nvals)
 		ctx->commandy = vals[nvals-1];
 	}
 
-	// transform commands
-	i = 0;
+	// transform commands, unless the transform is identity
+	i = state->xformClass == NVG_XFORM_IDENTITY ? nvals : 0;
 	while (i < nvals) {
 		int cmd = (int)vals[i];
 		switch (cmd) {
@@ -1151,7 +1633,7 @@ static void nvg__addPath(NVGcontext* ctx)
 	if (ctx->cache->npaths+1 > ctx->cache->cpaths) {
 		NVGpath* paths;
 		int cpaths = ctx->cache->npaths+1 + ctx->cache->cpaths/2;
-		paths = (NVGpath*)realloc(ctx->cache->paths, sizeof(NVGpath)*cpaths);
+		paths = (NVGpath*)BX_REALLOC(ctx->params.allocator, ctx->cache->paths, sizeof(NVGpath)*cpaths);
 		if (paths == NULL) return;
 		ctx->cache->paths = paths;
 		ctx->cache->cpaths = cpaths;
@@ -1188,7 +1670,7 @@ static void nvg__addPoint(NVGcontext* ctx, float x, float y, int flags)
 	if (ctx->cache->npoints+1 > ctx->cache->cpoints) {
 		NVGpoint* points;
 		int cpoints = ctx->cache->npoints+1 + ctx->cache->cpoints/2;
-		points = (NVGpoint*)realloc(ctx->cache->points, sizeof(NVGpoint)*cpoints);
+		points = (NVGpoint*)BX_REALLOC(ctx->params.allocator, ctx->cache->points, sizeof(NVGpoint)*cpoints);
 		if (points == NULL) return;
 		ctx->cache->points = points;
 		ctx->cache->cpoints = cpoints;
@@ -1225,12 +1707,25 @@ static float nvg__getAverageScale(float *t)
 	return (sx + sy) * 0.5f;
 }
 
+static float nvg__getStateScale(NVGstate* state)
+{
+	switch (state->xformClass) {
+	case NVG_XFORM_IDENTITY:
+	case NVG_XFORM_TRANSLATE:
+		return 1.0f;
+	case NVG_XFORM_SCALE:
+		return (nvg__absf(state->xform[0]) + nvg__absf(state->xform[3])) * 0.5f;
+	default:
+		return nvg__getAverageScale(state->xform);
+	}
+}
+
 static NVGvertex* nvg__allocTempVerts(NVGcontext* ctx, int nverts)
 {
 	if (nverts > ctx->cache->cverts) {
 		NVGvertex* verts;
 		int cverts = (nverts + 0xff) & ~0xff; // Round up to prevent allocations when things change just slightly.
-		verts = (NVGvertex*)realloc(ctx->cache->verts, sizeof(NVGvertex)*cverts);
+		verts = (NVGvertex*)BX_REALLOC(ctx->params.allocator, ctx->cache->verts, sizeof(NVGvertex)*cverts);
 		if (verts == NULL) return NULL;
 		ctx->cache->verts = verts;
 		ctx->cache->cverts = cverts;
@@ -1286,44 +1781,93 @@ static void nvg__vset(NVGvertex* vtx, float x, float y, float u, float v)
 static void nvg__tesselateBezier(NVGcontext* ctx,
 								 float x1, float y1, float x2, float y2,
 								 float x3, float y3, float x4, float y4,
-								 int level, int type)
+								 int type)
 {
-	float x12,y12,x23,y23,x34,y34,x123,y123,x234,y234,x1234,y1234;
-	float dx,dy,d2,d3;
-
-	if (level > 10) return;
-
-	x12 = (x1+x2)*0.5f;
-	y12 = (y1+y2)*0.5f;
-	x23 = (x2+x3)*0.5f;
-	y23 = (y2+y3)*0.5f;
-	x34 = (x3+x4)*0.5f;
-	y34 = (y3+y4)*0.5f;
-	x123 = (x12+x23)*0.5f;
-	y123 = (y12+y23)*0.5f;
+	NVGpathCache* cache = ctx->cache;
+	NVGpath* path = nvg__lastPath(ctx);
+	NVGpoint* pt;
+	float qax,qay,qbx,qby,qcx,qcy,ddx,ddy,dd,dt,px,py;
+#if defined(NVG_SIMD_SSE2) || defined(NVG_SIMD_NEON)
+	NVGlanes vt, vx, vy;
+	float xs[4], ys[4];
+	int j, m;
+#else
+	float t, x, y;
+#endif
+	int i, n;
 
-	dx = x4 - x1;
-	dy = y4 - y1;
-	d2 = nvg__absf(((x2 - x4) * dy - (y2 - y4) * dx));
-	d3 = nvg__absf(((x3 - x4) * dy - (y3 - y4) * dx));
+	if (path == NULL) return;
 
-	if ((d2 + d3)*(d2 + d3) < ctx->tessTol * (dx*dx + dy*dy)) {
-		nvg__addPoint(ctx, x4, y4, type);
-		return;
+	// A polyline through n evenly spaced points of a cubic is off the curve by at most
+	// 1/8 * max|B''| / n^2 = 3/4 * max(|P1-2P2+P3|, |P2-2P3+P4|) / n^2,
+	// which gives the number of segments keeping it within the tessellation tolerance.
+	ddx = x1 - 2*x2 + x3;
+	ddy = y1 - 2*y2 + y3;
+	dd = ddx*ddx + ddy*ddy;
+	ddx = x2 - 2*x3 + x4;
+	ddy = y2 - 2*y3 + y4;
+	dd = nvg__maxf(dd, ddx*ddx + ddy*ddy);
+	n = nvg__clampi((int)ceilf(sqrtf(0.75f * sqrtf(dd) / ctx->tessTol)), 1, NVG_MAX_BEZIER_STEPS);
+
+	if (cache->npoints+n > cache->cpoints) {
+		NVGpoint* points;
+		int cpoints = cache->npoints+n + cache->cpoints/2;
+		points = (NVGpoint*)BX_REALLOC(ctx->params.allocator, cache->points, sizeof(NVGpoint)*cpoints);
+		if (points == NULL) return;
+		cache->points = points;
+		cache->cpoints = cpoints;
 	}
 
-/*	if (nvg__absf(x1+x3-x2-x2) + nvg__absf(y1+y3-y2-y2) + nvg__absf(x2+x4-x3-x3) + nvg__absf(y2+y4-y3-y3) < ctx->tessTol) {
-		nvg__addPoint(ctx, x4, y4, type);
-		return;
-	}*/
-
-	x234 = (x23+x34)*0.5f;
-	y234 = (y23+y34)*0.5f;
-	x1234 = (x123+x234)*0.5f;
-	y1234 = (y123+y234)*0.5f;
+	// Points are evaluated independently from the polynomial form rather than by forward
+	// differencing, so that rounding does not accumulate along long curves, and four at a
+	// time where SIMD is available. Points closer than distTol are then dropped in order.
+	qax = -x1 + 3*(x2 - x3) + x4;
+	qay = -y1 + 3*(y2 - y3) + y4;
+	qbx = 3*(x1 - 2*x2 + x3);
+	qby = 3*(y1 - 2*y2 + y3);
+	qcx = 3*(x2 - x1);
+	qcy = 3*(y2 - y1);
+	dt = 1.0f / n;
+	px = x1;
+	py = y1;
+	pt = &cache->points[cache->npoints];
+#if defined(NVG_SIMD_SSE2) || defined(NVG_SIMD_NEON)
+	for (i = 1; i < n; i += 4) {
+		m = nvg__mini(4, n - i);
+		vt = nvg__lanesMul(nvg__lanesAdd(nvg__lanesSplat((float)i), nvg__lanesSet(0.0f, 1.0f, 2.0f, 3.0f)), nvg__lanesSplat(dt));
+		vx = nvg__lanesAdd(nvg__lanesMul(vt, nvg__lanesSplat(qax)), nvg__lanesSplat(qbx));
+		vy = nvg__lanesAdd(nvg__lanesMul(vt, nvg__lanesSplat(qay)), nvg__lanesSplat(qby));
+		vx = nvg__lanesAdd(nvg__lanesMul(vx, vt), nvg__lanesSplat(qcx));
+		vy = nvg__lanesAdd(nvg__lanesMul(vy, vt), nvg__lanesSplat(qcy));
+		nvg__lanesStore(xs, nvg__lanesAdd(nvg__lanesMul(vx, vt), nvg__lanesSplat(x1)));
+		nvg__lanesStore(ys, nvg__lanesAdd(nvg__lanesMul(vy, vt), nvg__lanesSplat(y1)));
+		for (j = 0; j < m; j++) {
+			if (nvg__ptEquals(px,py, xs[j],ys[j], ctx->distTol))
+				continue;
+			memset(pt, 0, sizeof(*pt));
+			pt->x = px = xs[j];
+			pt->y = py = ys[j];
+			pt++;
+		}
+	}
+#else
+	for (i = 1; i < n; i++) {
+		t = i * dt;
+		x = ((qax*t + qbx)*t + qcx)*t + x1;
+		y = ((qay*t + qby)*t + qcy)*t + y1;
+		if (nvg__ptEquals(px,py, x,y, ctx->distTol))
+			continue;
+		memset(pt, 0, sizeof(*pt));
+		pt->x = px = x;
+		pt->y = py = y;
+		pt++;
+	}
+#endif
+	n = (int)(pt - &cache->points[cache->npoints]);
+	cache->npoints += n;
+	path->count += n;
 
-	nvg__tesselateBezier(ctx, x1,y1, x12,y12, x123,y123, x1234,y1234, level+1, 0);
-	nvg__tesselateBezier(ctx, x1234,y1234, x234,y234, x34,y34, x4,y4, level+1, type);
+	nvg__addPoint(ctx, x4, y4, type);
 }
 
 static void nvg__flattenPaths(NVGcontext* ctx)
@@ -1366,7 +1910,7 @@ static void nvg__flattenPaths(NVGcontext* ctx)
 				cp1 = &ctx->commands[i+1];
 				cp2 = &ctx->commands[i+3];
 				p = &ctx->commands[i+5];
-				nvg__tesselateBezier(ctx, last->x,last->y, cp1[0],cp1[1], cp2[0],cp2[1], p[0],p[1], 0, NVG_PT_CORNER);
+				nvg__tesselateBezier(ctx, last->x,last->y, cp1[0],cp1[1], cp2[0],cp2[1], p[0],p[1], NVG_PT_CORNER);
 			}
 			i += 7;
 			break;
@@ -1655,6 +2199,169 @@ static NVGvertex* nvg__roundCapEnd(NVGvertex* dst, NVGpoint* p,
 }
 
 
+// Calculates the extrusion and flags of the join at p1, returns the flags.
+static int nvg__calculateJoin(NVGpoint* p0, NVGpoint* p1, float iw, int lineJoin, float miterLimit)
+{
+	float dlx0, dly0, dlx1, dly1, dmx, dmy, dmr2, cross, limit;
+	int flags;
+	dlx0 = p0->dy;
+	dly0 = -p0->dx;
+	dlx1 = p1->dy;
+	dly1 = -p1->dx;
+	// Calculate extrusions
+	dmx = (dlx0 + dlx1) * 0.5f;
+	dmy = (dly0 + dly1) * 0.5f;
+	dmr2 = dmx*dmx + dmy*dmy;
+	if (dmr2 > 0.000001f) {
+		float scale = 1.0f / dmr2;
+		if (scale > 600.0f) {
+			scale = 600.0f;
+		}
+		dmx *= scale;
+		dmy *= scale;
+	}
+	p1->dmx = dmx;
+	p1->dmy = dmy;
+
+	// Clear flags, but keep the corner.
+	flags = p1->flags & NVG_PT_CORNER;
+
+	// Keep track of left turns.
+	cross = p1->dx * p0->dy - p0->dx * p1->dy;
+	flags |= (cross > 0.0f) * NVG_PT_LEFT;
+
+	// Calculate if we should use bevel or miter for inner join.
+	limit = nvg__maxf(1.01f, nvg__minf(p0->len, p1->len) * iw);
+	if ((dmr2 * limit*limit) < 1.0f)
+		flags |= NVG_PR_INNERBEVEL;
+
+	// Check to see if the corner needs to be beveled.
+	if (flags & NVG_PT_CORNER) {
+		if ((dmr2 * miterLimit*miterLimit) < 1.0f || lineJoin == NVG_BEVEL || lineJoin == NVG_ROUND) {
+			flags |= NVG_PT_BEVEL;
+		}
+	}
+
+	p1->flags = (unsigned char)flags;
+	return flags;
+}
+
+#if defined(NVG_SIMD_SSE2) || defined(NVG_SIMD_NEON)
+
+static int nvg__countBits4(int m)
+{
+	return (m & 1) + ((m >> 1) & 1) + ((m >> 2) & 1) + ((m >> 3) & 1);
+}
+
+// Calculates the joins at pts[0] to pts[npts-1] as nvg__calculateJoin() does, four points at a time,
+// and counts their left turns and bevels. The segment ending at pts[0] starts at pts[-1].
+// Returns the number of points done, the rest are left to nvg__calculateJoin().
+static int nvg__calculateJoinLanes(NVGpoint* pts, int npts, float iw, int lineJoin, float miterLimit,
+								   int* nleft, int* nbevel)
+{
+	const int stride = (int)(sizeof(NVGpoint) / sizeof(float));
+	NVGlanes dx0, dy0, len0, dx1, dy1, len1, dmx, dmy, dmr2, scale, limit, one, zero, r[4];
+	NVGlanes corner, left, innerBevel, bevel, bevelCorners;
+	int nl = 0, nb = 0;
+	int i;
+
+	one = nvg__lanesSplat(1.0f);
+	zero = nvg__lanesSplat(0.0f);
+	bevelCorners = nvg__lanesBits((lineJoin == NVG_BEVEL || lineJoin == NVG_ROUND) ? -1 : 0);
+	dx1 = nvg__lanesSplat(pts[-1].dx);
+	dy1 = nvg__lanesSplat(pts[-1].dy);
+	len1 = nvg__lanesSplat(pts[-1].len);
+
+	for (i = 0; i + 4 <= npts; i += 4) {
+		NVGpoint* p = &pts[i];
+
+		// The len, dmx, dmy and flags of each point, as lanes. The flags and the padding
+		// after them fill the last float, with the flags in its low byte.
+		r[0] = nvg__lanesLoad(&p[0].len);
+		r[1] = nvg__lanesLoad(&p[1].len);
+		r[2] = nvg__lanesLoad(&p[2].len);
+		r[3] = nvg__lanesLoad(&p[3].len);
+		nvg__lanesTranspose(&r[0], &r[1], &r[2], &r[3]);
+
+		// Segments starting at the points, and shifted by one lane, the segments ending at them.
+		dx0 = dx1;
+		dy0 = dy1;
+		len0 = len1;
+		dx1 = nvg__lanesGather(&p->dx, stride);
+		dy1 = nvg__lanesGather(&p->dy, stride);
+		len1 = r[0];
+		dx0 = nvg__lanesShift(dx0, dx1);
+		dy0 = nvg__lanesShift(dy0, dy1);
+		len0 = nvg__lanesShift(len0, len1);
+
+		// Calculate extrusions
+		dmx = nvg__lanesMul(nvg__lanesAdd(dy0, dy1), nvg__lanesSplat(0.5f));
+		dmy = nvg__lanesMul(nvg__lanesAdd(dx0, dx1), nvg__lanesSplat(-0.5f));
+		dmr2 = nvg__lanesAdd(nvg__lanesMul(dmx, dmx), nvg__lanesMul(dmy, dmy));
+		scale = nvg__lanesMin(nvg__lanesDiv(one, dmr2), nvg__lanesSplat(600.0f));
+		scale = nvg__lanesSelectGreater(dmr2, nvg__lanesSplat(0.000001f), scale, one);
+		r[1] = nvg__lanesMul(dmx, scale);
+		r[2] = nvg__lanesMul(dmy, scale);
+
+		// Flags, as in nvg__calculateJoin().
+		corner = nvg__lanesHasBits(r[3], NVG_PT_CORNER);
+		left = nvg__lanesLess(zero, nvg__lanesSub(nvg__lanesMul(dx1, dy0), nvg__lanesMul(dx0, dy1)));
+		limit = nvg__lanesMax(nvg__lanesSplat(1.01f), nvg__lanesMul(nvg__lanesMin(len0, len1), nvg__lanesSplat(iw)));
+		innerBevel = nvg__lanesLess(nvg__lanesMul(nvg__lanesMul(dmr2, limit), limit), one);
+		bevel = nvg__lanesLess(nvg__lanesMul(nvg__lanesMul(dmr2, nvg__lanesSplat(miterLimit)), nvg__lanesSplat(miterLimit)), one);
+		bevel = nvg__lanesAnd(corner, nvg__lanesOr(bevel, bevelCorners));
+		r[3] = nvg__lanesOr(nvg__lanesOr(nvg__lanesAnd(corner, nvg__lanesBits(NVG_PT_CORNER)),
+										 nvg__lanesAnd(left, nvg__lanesBits(NVG_PT_LEFT))),
+							nvg__lanesOr(nvg__lanesAnd(bevel, nvg__lanesBits(NVG_PT_BEVEL)),
+										 nvg__lanesAnd(innerBevel, nvg__lanesBits(NVG_PR_INNERBEVEL))));
+		nl += nvg__countBits4(nvg__lanesMask(left));
+		nb += nvg__countBits4(nvg__lanesMask(nvg__lanesOr(bevel, innerBevel)));
+
+		nvg__lanesTranspose(&r[0], &r[1], &r[2], &r[3]);
+		nvg__lanesStore(&p[0].len, r[0]);
+		nvg__lanesStore(&p[1].len, r[1]);
+		nvg__lanesStore(&p[2].len, r[2]);
+		nvg__lanesStore(&p[3].len, r[3]);
+	}
+
+	*nleft += nl;
+	*nbevel += nb;
+	return i;
+}
+
+// Adds the vertices of the miter joins at p1[0] to p1[3], which must have no bevel flags.
+static NVGvertex* nvg__miterJoinLanes(NVGvertex* dst, NVGpoint* p1, float w, float u0, float u1)
+{
+	const int stride = (int)(sizeof(NVGpoint) / sizeof(float));
+	NVGlanes x, y, dmx, dmy, l[4], r[4];
+	int k;
+
+	x = nvg__lanesGather(&p1[0].x, stride);
+	y = nvg__lanesGather(&p1[0].y, stride);
+	dmx = nvg__lanesMul(nvg__lanesGather(&p1[0].dmx, stride), nvg__lanesSplat(w));
+	dmy = nvg__lanesMul(nvg__lanesGather(&p1[0].dmy, stride), nvg__lanesSplat(w));
+
+	// Rows of x, y, u and v become the left and right vertex of each point.
+	l[0] = nvg__lanesAdd(x, dmx);
+	l[1] = nvg__lanesAdd(y, dmy);
+	l[2] = nvg__lanesSplat(u0);
+	l[3] = nvg__lanesSplat(1.0f);
+	r[0] = nvg__lanesSub(x, dmx);
+	r[1] = nvg__lanesSub(y, dmy);
+	r[2] = nvg__lanesSplat(u1);
+	r[3] = l[3];
+	nvg__lanesTranspose(&l[0], &l[1], &l[2], &l[3]);
+	nvg__lanesTranspose(&r[0], &r[1], &r[2], &r[3]);
+
+	for (k = 0; k < 4; k++) {
+		nvg__lanesStore(&dst->x, l[k]); dst++;
+		nvg__lanesStore(&dst->x, r[k]); dst++;
+	}
+	return dst;
+}
+
+#endif // NVG_SIMD_SSE2 || NVG_SIMD_NEON
+
 static void nvg__calculateJoins(NVGcontext* ctx, float w, int lineJoin, float miterLimit)
 {
 	NVGpathCache* cache = ctx->cache;
@@ -1664,62 +2371,32 @@ static void nvg__calculateJoins(NVGcontext* ctx, float w, int lineJoin, float mi
 	if (w > 0.0f) iw = 1.0f / w;
 
 	// Calculate which joins needs extra vertices to append, and gather vertex count.
+	// Past the first point, whose segment before it is the last one of the path,
+	// points are taken four at a time where SIMD is available.
 	for (i = 0; i < cache->npaths; i++) {
 		NVGpath* path = &cache->paths[i];
 		NVGpoint* pts = &cache->points[path->first];
 		NVGpoint* p0 = &pts[path->count-1];
 		NVGpoint* p1 = &pts[0];
 		int nleft = 0;
-
-		path->nbevel = 0;
+		int nbevel = 0;
 
 		for (j = 0; j < path->count; j++) {
-			float dlx0, dly0, dlx1, dly1, dmr2, cross, limit;
-			dlx0 = p0->dy;
-			dly0 = -p0->dx;
-			dlx1 = p1->dy;
-			dly1 = -p1->dx;
-			// Calculate extrusions
-			p1->dmx = (dlx0 + dlx1) * 0.5f;
-			p1->dmy = (dly0 + dly1) * 0.5f;
-			dmr2 = p1->dmx*p1->dmx + p1->dmy*p1->dmy;
-			if (dmr2 > 0.000001f) {
-				float scale = 1.0f / dmr2;
-				if (scale > 600.0f) {
-					scale = 600.0f;
-				}
-				p1->dmx *= scale;
-				p1->dmy *= scale;
-			}
-
-			// Clear flags, but keep the corner.
-			p1->flags = (p1->flags & NVG_PT_CORNER) ? NVG_PT_CORNER : 0;
-
-			// Keep track of left turns.
-			cross = p1->dx * p0->dy - p0->dx * p1->dy;
-			if (cross > 0.0f) {
-				nleft++;
-				p1->flags |= NVG_PT_LEFT;
-			}
-
-			// Calculate if we should use bevel or miter for inner join.
-			limit = nvg__maxf(1.01f, nvg__minf(p0->len, p1->len) * iw);
-			if ((dmr2 * limit*limit) < 1.0f)
-				p1->flags |= NVG_PR_INNERBEVEL;
-
-			// Check to see if the corner needs to be beveled.
-			if (p1->flags & NVG_PT_CORNER) {
-				if ((dmr2 * miterLimit*miterLimit) < 1.0f || lineJoin == NVG_BEVEL || lineJoin == NVG_ROUND) {
-					p1->flags |= NVG_PT_BEVEL;
-				}
-			}
-
-			if ((p1->flags & (NVG_PT_BEVEL | NVG_PR_INNERBEVEL)) != 0)
-				path->nbevel++;
-
+			int flags = nvg__calculateJoin(p0, p1, iw, lineJoin, miterLimit);
+			nleft += (flags & NVG_PT_LEFT) != 0;
+			nbevel += (flags & (NVG_PT_BEVEL | NVG_PR_INNERBEVEL)) != 0;
 			p0 = p1++;
+#if defined(NVG_SIMD_SSE2) || defined(NVG_SIMD_NEON)
+			if (j == 0 && path->count > 1) {
+				int n = nvg__calculateJoinLanes(p1, path->count-1, iw, lineJoin, miterLimit, &nleft, &nbevel);
+				p1 += n;
+				p0 = p1 - 1;
+				j += n;
+			}
+#endif
 		}
 
+		path->nbevel = nbevel;
 		path->convex = (nleft == path->count) ? 1 : 0;
 	}
 }
@@ -1811,6 +2488,15 @@ static int nvg__expandStroke(NVGcontext* ctx, float w, float fringe, int lineCap
 		}
 
 		for (j = s; j < e; ++j) {
+#if defined(NVG_SIMD_SSE2) || defined(NVG_SIMD_NEON)
+			if (j + 4 <= e && ((p1[0].flags | p1[1].flags | p1[2].flags | p1[3].flags) & (NVG_PT_BEVEL | NVG_PR_INNERBEVEL)) == 0) {
+				dst = nvg__miterJoinLanes(dst, p1, w, u0, u1);
+				p0 = p1 + 3;
+				p1 += 4;
+				j += 3;
+				continue;
+			}
+#endif
 			if ((p1->flags & (NVG_PT_BEVEL | NVG_PR_INNERBEVEL)) != 0) {
 				if (lineJoin == NVG_ROUND) {
 					dst = nvg__roundJoin(dst, p0, p1, w, w, u0, u1, ncap, aa);
@@ -1934,8 +2620,10 @@ static int nvg__expandFill(NVGcontext* ctx, float w, int lineJoin, float miterLi
 			path->stroke = dst;
 
 			// Create only half a fringe for convex shapes so that
-			// the shape can be rendered without stenciling.
-			if (convex) {
+			// the shape can be rendered without stenciling. Small concave
+			// shapes get the same when the back-end triangulates them,
+			// stenciling only shows the outer half of the fringe anyway.
+			if (convex || (cache->npaths == 1 && path->nfill <= ctx->params.maxTriangulatedFill)) {
 				lw = woff;	// This should generate the same vertex as fill inset above.
 				lu = 0.5f;	// Set outline fade at middle.
 			}
@@ -1975,6 +2663,7 @@ void nvgBeginPath(NVGcontext* ctx)
 {
 	ctx->ncommands = 0;
 	nvg__clearPathCache(ctx);
+	ctx->deferredPath = -1;
 }
 
 void nvgMoveTo(NVGcontext* ctx, float x, float y)
@@ -2074,6 +2763,56 @@ void nvgPathWinding(NVGcontext* ctx, int dir)
 	nvg__appendCommands(ctx, vals, NVG_COUNTOF(vals));
 }
 
+void nvgAppendPath(NVGcontext* ctx, const float* commands, int ncommands)
+{
+	// Number of values and points following each command.
+	static const int sizes[] = { 2, 2, 6, 0, 1 };
+	static const int npoints[] = { 1, 1, 3, 0, 0 };
+	NVGstate* state = nvg__getState(ctx);
+	float t[6];
+	float* dst;
+	int i, n = 0, last = -1;
+
+	if (ncommands <= 0) return;
+
+	if (ctx->ncommands+ncommands > ctx->ccommands) {
+		int ccommands = ctx->ncommands+ncommands + ctx->ccommands/2;
+		float* buf = (float*)BX_REALLOC(ctx->params.allocator, ctx->commands, sizeof(float)*ccommands);
+		if (buf == NULL) return;
+		ctx->commands = buf;
+		ctx->ccommands = ccommands;
+	}
+
+	// Copy and transform in one pass, stopping at the first invalid or incomplete command.
+	memcpy(t, state->xform, sizeof(float)*6);
+	dst = &ctx->commands[ctx->ncommands];
+	while (n < ncommands) {
+		float c = commands[n];
+		int cmd = c == 1.0f ? NVG_LINETO : (int)c; // Lines dominate, skip the conversion for them.
+		const float* src;
+		float* pt;
+		if (cmd < NVG_MOVETO || cmd > NVG_WINDING || n+1+sizes[cmd] > ncommands) break;
+		dst[n] = commands[n];
+		src = &commands[n+1];
+		pt = &dst[n+1];
+		for (i = 0; i < npoints[cmd]; i++) {
+			pt[i*2+0] = src[i*2]*t[0] + src[i*2+1]*t[2] + t[4];
+			pt[i*2+1] = src[i*2]*t[1] + src[i*2+1]*t[3] + t[5];
+		}
+		if (cmd == NVG_WINDING)
+			pt[0] = src[0];
+		n += 1+sizes[cmd];
+		if (npoints[cmd] > 0)
+			last = n;
+	}
+
+	if (last != -1) {
+		ctx->commandx = commands[last-2];
+		ctx->commandy = commands[last-1];
+	}
+	ctx->ncommands += n;
+}
+
 void nvgArc(NVGcontext* ctx, float cx, float cy, float r, float a0, float a1, int dir)
 {
 	float a = 0, da = 0, hda = 0, kappa = 0;
@@ -2224,25 +2963,738 @@ void nvgDebugDumpPathCache(NVGcontext* ctx)
 	}
 }
 
-void nvgFill(NVGcontext* ctx)
+// Display lists
+
+static void* nvg__reserve(NVGcontext* ctx, void* items, int* capacity, int count, int itemSize)
 {
-	NVGstate* state = nvg__getState(ctx);
-	const NVGpath* path;
-	NVGpaint fillPaint = state->fill;
-	int i;
+	if (count > *capacity) {
+		int c = nvg__maxi(count, *capacity*2);
+		void* p = BX_REALLOC(ctx->params.allocator, items, (size_t)itemSize*c);
+		if (p == NULL) return NULL;
+		*capacity = c;
+		return p;
+	}
+	return items;
+}
 
-	nvg__flattenPaths(ctx);
-	if (ctx->params.edgeAntiAlias && state->shapeAntiAlias)
-		nvg__expandFill(ctx, ctx->fringeWidth, NVG_MITER, 2.4f);
-	else
-		nvg__expandFill(ctx, 0.0f, NVG_MITER, 2.4f);
+static NVGrecordedCall* nvg__recordCall(NVGcontext* ctx, int type, NVGpaint* paint, NVGcompositeOperationState compositeOperation, NVGscissor* scissor)
+{
+	NVGdisplayList* list = ctx->recording;
+	NVGrecordedCall* calls = (NVGrecordedCall*)nvg__reserve(ctx, list->calls, &list->ccalls, list->ncalls+1, sizeof(NVGrecordedCall));
+	NVGrecordedCall* call;
+	if (calls == NULL) {
+		list->valid = 0;
+		return NULL;
+	}
+	list->calls = calls;
+
+	call = &list->calls[list->ncalls++];
+	memset(call, 0, sizeof(*call));
+	call->type = type;
+	call->paint = *paint;
+	call->compositeOperation = compositeOperation;
+	call->scissor = *scissor;
+	call->firstPath = list->npaths;
+	call->firstVert = list->nverts;
+	return call;
+}
+
+static int nvg__recordVerts(NVGcontext* ctx, const NVGvertex* verts, int nverts)
+{
+	NVGdisplayList* list = ctx->recording;
+	NVGvertex* dst = (NVGvertex*)nvg__reserve(ctx, list->verts, &list->cverts, list->nverts+nverts, sizeof(NVGvertex));
+	int first = list->nverts;
+	// Nothing is allocated yet when the first vertices recorded are none, like the fill of a stroke.
+	if (dst == NULL && nverts > 0) {
+		list->valid = 0;
+		return 0;
+	}
+	list->verts = dst;
+	if (nverts > 0)
+		memcpy(&list->verts[first], verts, sizeof(NVGvertex)*nverts);
+	list->nverts += nverts;
+	return first;
+}
 
-	// Apply global alpha
+static void nvg__recordPaths(NVGcontext* ctx, NVGrecordedCall* call, const NVGpath* paths, int npaths)
+{
+	NVGdisplayList* list = ctx->recording;
+	NVGrecordedPath* dst = (NVGrecordedPath*)nvg__reserve(ctx, list->paths, &list->cpaths, list->npaths+npaths, sizeof(NVGrecordedPath));
+	int i;
+	if (dst == NULL && npaths > 0) {
+		list->valid = 0;
+		return;
+	}
+	list->paths = dst;
+	for (i = 0; i < npaths; i++) {
+		NVGrecordedPath* path = &list->paths[list->npaths++];
+		path->path = paths[i];
+		path->path.fill = NULL;
+		path->path.stroke = NULL;
+		path->fill = nvg__recordVerts(ctx, paths[i].fill, paths[i].nfill);
+		path->stroke = nvg__recordVerts(ctx, paths[i].stroke, paths[i].nstroke);
+	}
+	call->npaths = npaths;
+}
+
+static void nvg__submitFill(NVGcontext* ctx, NVGpaint* paint, NVGcompositeOperationState compositeOperation, NVGscissor* scissor, float fringe,
+							const float* bounds, const NVGpath* paths, int npaths)
+{
+	NVGrecordedCall* call;
+	if (ctx->recording == NULL) {
+		ctx->params.renderFill(ctx->params.userPtr, paint, compositeOperation, scissor, fringe, bounds, paths, npaths);
+		return;
+	}
+	call = nvg__recordCall(ctx, NVG_RECORDED_FILL, paint, compositeOperation, scissor);
+	if (call == NULL) return;
+	call->fringe = fringe;
+	memcpy(call->bounds, bounds, sizeof(float)*4);
+	nvg__recordPaths(ctx, call, paths, npaths);
+}
+
+static void nvg__submitStroke(NVGcontext* ctx, NVGpaint* paint, NVGcompositeOperationState compositeOperation, NVGscissor* scissor, float fringe,
+							  float strokeWidth, const NVGpath* paths, int npaths)
+{
+	NVGrecordedCall* call;
+	if (ctx->recording == NULL) {
+		ctx->params.renderStroke(ctx->params.userPtr, paint, compositeOperation, scissor, fringe, strokeWidth, paths, npaths);
+		return;
+	}
+	call = nvg__recordCall(ctx, NVG_RECORDED_STROKE, paint, compositeOperation, scissor);
+	if (call == NULL) return;
+	call->fringe = fringe;
+	call->strokeWidth = strokeWidth;
+	nvg__recordPaths(ctx, call, paths, npaths);
+}
+
+static void nvg__recordText(NVGcontext* ctx)
+{
+	NVGdisplayList* list = ctx->recording;
+	// Glyphs are only found where they were while the whole list was recorded.
+	if (list->fontAtlasGeneration == -1)
+		list->fontAtlasGeneration = ctx->fontAtlasGeneration;
+	else if (list->fontAtlasGeneration != ctx->fontAtlasGeneration)
+		list->valid = 0;
+}
+
+static void nvg__submitTriangles(NVGcontext* ctx, NVGpaint* paint, NVGcompositeOperationState compositeOperation, NVGscissor* scissor,
+								 const NVGvertex* verts, int nverts)
+{
+	NVGrecordedCall* call;
+	if (ctx->recording == NULL) {
+		ctx->params.renderTriangles(ctx->params.userPtr, paint, compositeOperation, scissor, verts, nverts);
+		return;
+	}
+	call = nvg__recordCall(ctx, NVG_RECORDED_TRIANGLES, paint, compositeOperation, scissor);
+	if (call == NULL) return;
+	call->firstVert = nvg__recordVerts(ctx, verts, nverts);
+	call->nverts = nverts;
+	nvg__recordText(ctx);
+}
+
+NVGdisplayList* nvgCreateDisplayList(NVGcontext* ctx)
+{
+	NVGdisplayList* list = (NVGdisplayList*)BX_ALLOC(ctx->params.allocator, sizeof(NVGdisplayList));
+	if (list == NULL) return NULL;
+	memset(list, 0, sizeof(NVGdisplayList));
+	nvgTransformIdentity(list->xform);
+	list->fontAtlasGeneration = -1;
+	return list;
+}
+
+void nvgDeleteDisplayList(NVGcontext* ctx, NVGdisplayList* list)
+{
+	if (list == NULL) return;
+	while (ctx->recording == list)
+		nvgEndRecord(ctx);
+	if (list->calls != NULL) BX_FREE(ctx->params.allocator, list->calls);
+	if (list->paths != NULL) BX_FREE(ctx->params.allocator, list->paths);
+	if (list->verts != NULL) BX_FREE(ctx->params.allocator, list->verts);
+	BX_FREE(ctx->params.allocator, list);
+}
+
+void nvgBeginRecord(NVGcontext* ctx, NVGdisplayList* list)
+{
+	NVGstate* state = nvg__getState(ctx);
+
+	// Calls drawn before belong to the frame.
+	nvg__flushDeferred(ctx);
+
+	list->ncalls = 0;
+	list->npaths = 0;
+	list->nverts = 0;
+	memcpy(list->xform, state->xform, sizeof(float)*6);
+	list->fontAtlasGeneration = -1;
+	list->valid = 1;
+	list->parent = ctx->recording;
+	ctx->recording = list;
+}
+
+void nvgEndRecord(NVGcontext* ctx)
+{
+	if (ctx->recording == NULL) return;
+	nvg__flushDeferred(ctx);
+	ctx->recording = ctx->recording->parent;
+}
+
+static void nvg__transformBounds(float* dst, const float* t, const float* bounds)
+{
+	float x0, y0, x1, y1, x2, y2, x3, y3;
+	nvgTransformPoint(&x0, &y0, t, bounds[0], bounds[1]);
+	nvgTransformPoint(&x1, &y1, t, bounds[2], bounds[1]);
+	nvgTransformPoint(&x2, &y2, t, bounds[2], bounds[3]);
+	nvgTransformPoint(&x3, &y3, t, bounds[0], bounds[3]);
+	dst[0] = nvg__minf(nvg__minf(x0, x1), nvg__minf(x2, x3));
+	dst[1] = nvg__minf(nvg__minf(y0, y1), nvg__minf(y2, y3));
+	dst[2] = nvg__maxf(nvg__maxf(x0, x1), nvg__maxf(x2, x3));
+	dst[3] = nvg__maxf(nvg__maxf(y0, y1), nvg__maxf(y2, y3));
+}
+
+// Intersects scissor 'a' with 'b' in the space of 'b', an approximation
+// when they are rotated differently, like nvgIntersectScissor().
+static void nvg__isectScissors(NVGscissor* dst, const NVGscissor* a, const NVGscissor* b)
+{
+	NVGscissor res;
+	float pxform[6], invxform[6];
+	float rect[4];
+	float tex, tey;
+
+	if (a->extent[0] < 0) {
+		*dst = *b;
+		return;
+	}
+	if (b->extent[0] < 0) {
+		*dst = *a;
+		return;
+	}
+
+	memcpy(pxform, a->xform, sizeof(float)*6);
+	nvgTransformInverse(invxform, b->xform);
+	nvgTransformMultiply(pxform, invxform);
+	tex = a->extent[0]*nvg__absf(pxform[0]) + a->extent[1]*nvg__absf(pxform[2]);
+	tey = a->extent[0]*nvg__absf(pxform[1]) + a->extent[1]*nvg__absf(pxform[3]);
+	nvg__isectRects(rect, pxform[4]-tex,pxform[5]-tey,tex*2,tey*2, -b->extent[0],-b->extent[1],b->extent[0]*2,b->extent[1]*2);
+
+	nvgTransformIdentity(res.xform);
+	res.xform[4] = rect[0]+rect[2]*0.5f;
+	res.xform[5] = rect[1]+rect[3]*0.5f;
+	nvgTransformMultiply(res.xform, b->xform);
+	res.extent[0] = rect[2]*0.5f;
+	res.extent[1] = rect[3]*0.5f;
+	*dst = res;
+}
+
+static const NVGpath* nvg__replayPaths(NVGcontext* ctx, NVGdisplayList* list, NVGrecordedCall* call, const float* t)
+{
+	NVGrecordedPath* src = &list->paths[call->firstPath];
+	NVGvertex* verts = list->verts;
+	NVGpath* paths;
+	int i, j;
+
+	paths = (NVGpath*)nvg__reserve(ctx, ctx->replayPaths, &ctx->creplayPaths, call->npaths, sizeof(NVGpath));
+	if (paths == NULL) return NULL;
+	ctx->replayPaths = paths;
+
+	if (t != NULL) {
+		// Vertices of the call's paths are recorded one after the other.
+		int first = call->npaths > 0 ? src[0].fill : 0;
+		int nverts = 0;
+		for (i = 0; i < call->npaths; i++)
+			nverts = src[i].stroke + src[i].path.nstroke - first;
+		verts = (NVGvertex*)nvg__reserve(ctx, ctx->replayVerts, &ctx->creplayVerts, nverts, sizeof(NVGvertex));
+		if (verts == NULL) return NULL;
+		ctx->replayVerts = verts;
+		for (j = 0; j < nverts; j++) {
+			const NVGvertex* v = &list->verts[first+j];
+			verts[j].x = v->x*t[0] + v->y*t[2] + t[4];
+			verts[j].y = v->x*t[1] + v->y*t[3] + t[5];
+			verts[j].u = v->u;
+			verts[j].v = v->v;
+		}
+		verts -= first;
+	}
+
+	for (i = 0; i < call->npaths; i++) {
+		paths[i] = src[i].path;
+		paths[i].fill = &verts[src[i].fill];
+		paths[i].stroke = &verts[src[i].stroke];
+	}
+	return paths;
+}
+
+int nvgReplay(NVGcontext* ctx, NVGdisplayList* list)
+{
+	NVGstate* state = nvg__getState(ctx);
+	float t[6], inv[6];
+	const float* pt = t;
+	int i, j;
+
+	if (!list->valid || ctx->recording == list)
+		return 0;
+	if (list->fontAtlasGeneration != -1 && list->fontAtlasGeneration != ctx->fontAtlasGeneration)
+		return 0;
+
+	nvg__flushDeferred(ctx);
+
+	// Transform from where the list was recorded to the current transform.
+	if (!nvgTransformInverse(inv, list->xform))
+		nvgTransformIdentity(inv);
+	memcpy(t, inv, sizeof(float)*6);
+	nvgTransformMultiply(t, state->xform);
+	if (t[0] == 1.0f && t[1] == 0.0f && t[2] == 0.0f && t[3] == 1.0f && t[4] == 0.0f && t[5] == 0.0f)
+		pt = NULL;
+
+	for (i = 0; i < list->ncalls; i++) {
+		NVGrecordedCall* call = &list->calls[i];
+		NVGpaint paint = call->paint;
+		NVGscissor scissor = call->scissor;
+		const NVGpath* paths = NULL;
+		float bounds[4];
+
+		paint.innerColor.a *= state->alpha;
+		paint.outerColor.a *= state->alpha;
+		if (pt != NULL) {
+			nvgTransformMultiply(paint.xform, pt);
+			if (scissor.extent[0] >= 0)
+				nvgTransformMultiply(scissor.xform, pt);
+		}
+		nvg__isectScissors(&scissor, &scissor, &state->scissor);
+
+		switch (call->type) {
+		case NVG_RECORDED_FILL:
+			paths = nvg__replayPaths(ctx, list, call, pt);
+			if (paths == NULL) break;
+			if (pt != NULL)
+				nvg__transformBounds(bounds, pt, call->bounds);
+			else
+				memcpy(bounds, call->bounds, sizeof(float)*4);
+			nvg__submitFill(ctx, &paint, call->compositeOperation, &scissor, call->fringe, bounds, paths, call->npaths);
+			ctx->drawCallCount += call->npaths*2;
+			break;
+		case NVG_RECORDED_STROKE:
+			paths = nvg__replayPaths(ctx, list, call, pt);
+			if (paths == NULL) break;
+			nvg__submitStroke(ctx, &paint, call->compositeOperation, &scissor, call->fringe, call->strokeWidth, paths, call->npaths);
+			ctx->drawCallCount += call->npaths;
+			break;
+		case NVG_RECORDED_TRIANGLES: {
+			const NVGvertex* verts = &list->verts[call->firstVert];
+			if (pt != NULL) {
+				NVGvertex* dst = (NVGvertex*)nvg__reserve(ctx, ctx->replayVerts, &ctx->creplayVerts, call->nverts, sizeof(NVGvertex));
+				if (dst == NULL) break;
+				ctx->replayVerts = dst;
+				for (j = 0; j < call->nverts; j++) {
+					dst[j].x = verts[j].x*pt[0] + verts[j].y*pt[2] + pt[4];
+					dst[j].y = verts[j].x*pt[1] + verts[j].y*pt[3] + pt[5];
+					dst[j].u = verts[j].u;
+					dst[j].v = verts[j].v;
+				}
+				verts = dst;
+			}
+			nvg__submitTriangles(ctx, &paint, call->compositeOperation, &scissor, verts, call->nverts);
+			ctx->drawCallCount++;
+			ctx->textTriCount += call->nverts/3;
+			break;
+		}
+		}
+	}
+	return 1;
+}
+
+// Tessellates the call in the path cache of 'tess' and records the paths and vertices
+// into the display list 'tess' records to, which the call points to once done.
+static void nvg__tessellateDeferred(NVGcontext* tess, NVGdeferredCall* call, float* commands)
+{
+	NVGdisplayList* output = tess->recording;
+	NVGpathCache* cache = tess->cache;
+	int first = output->ncalls;
+
+	tess->commands = &commands[call->firstCommand];
+	tess->ncommands = call->ncommands;
+
+	// Like a path filled and stroked right away, the path is flattened once.
+	if (!call->sharesPath)
+		nvg__clearPathCache(tess);
+	nvg__flattenPaths(tess);
+	output->valid = 1;
+	if (call->type == NVG_DEFERRED_FILL) {
+		if (nvg__expandFill(tess, call->antiAlias ? tess->fringeWidth : 0.0f, NVG_MITER, 2.4f))
+			nvg__submitFill(tess, &call->paint, call->compositeOperation, &call->scissor, tess->fringeWidth,
+							cache->bounds, cache->paths, cache->npaths);
+	} else {
+		if (nvg__expandStroke(tess, call->strokeWidth*0.5f, call->antiAlias ? tess->fringeWidth : 0.0f,
+							  call->lineCap, call->lineJoin, call->miterLimit))
+			nvg__submitStroke(tess, &call->paint, call->compositeOperation, &call->scissor, tess->fringeWidth,
+							  call->strokeWidth, cache->paths, cache->npaths);
+	}
+
+	call->output = output;
+	call->recorded = output->valid && output->ncalls > first ? first : -1;
+}
+
+static void nvg__runDeferred(NVGcontext* ctx, NVGcontext* tess, int32_t* next)
+{
+	tess->tessTol = ctx->tessTol;
+	tess->distTol = ctx->distTol;
+	tess->fringeWidth = ctx->fringeWidth;
+	tess->recording->ncalls = 0;
+	tess->recording->npaths = 0;
+	tess->recording->nverts = 0;
+
+	for (;;) {
+#if NVG_TESS_THREADS > 0
+		int32_t i = bx::atomicFetchAndAdd<int32_t>(next, 1);
+#else
+		int32_t i = (*next)++;
+#endif
+		if (i >= ctx->ndeferred)
+			break;
+		// Taken along with the call it shares the path of.
+		if (ctx->deferred[i].sharesPath)
+			continue;
+		do {
+			nvg__tessellateDeferred(tess, &ctx->deferred[i], ctx->deferredCommands);
+			i++;
+		} while (i < ctx->ndeferred && ctx->deferred[i].sharesPath);
+	}
+}
+
+static void nvg__deleteTessContext(bx::AllocatorI* allocator, NVGcontext* tess)
+{
+	NVGdisplayList* output;
+	if (tess == NULL) return;
+	output = tess->recording;
+	tess->recording = NULL;
+	nvgDeleteDisplayList(tess, output);
+	nvg__deletePathCache(allocator, tess->cache);
+	BX_FREE(allocator, tess);
+}
+
+// Context holding just what tessellation uses, so that calls can be tessellated
+// on other threads without touching the path being built. Its path cache is reused
+// for every call it takes and its output grows to the largest batch it tessellated.
+static NVGcontext* nvg__createTessContext(NVGcontext* ctx)
+{
+	NVGcontext* tess = (NVGcontext*)BX_ALLOC(ctx->params.allocator, sizeof(NVGcontext));
+	if (tess == NULL) return NULL;
+	memset(tess, 0, sizeof(NVGcontext));
+	tess->params.allocator = ctx->params.allocator;
+	tess->params.maxTriangulatedFill = ctx->params.maxTriangulatedFill;
+	tess->cache = nvg__allocPathCache(ctx->params.allocator);
+	tess->recording = nvgCreateDisplayList(tess);
+	if (tess->cache == NULL || tess->recording == NULL) {
+		nvg__deleteTessContext(ctx->params.allocator, tess);
+		return NULL;
+	}
+	return tess;
+}
+
+#if NVG_TESS_THREADS > 0
+
+struct NVGtessWorker
+{
+	bx::Thread thread;
+	struct NVGtessPool* pool;
+	NVGcontext* tess;
+};
+typedef struct NVGtessWorker NVGtessWorker;
+
+struct NVGtessPool
+{
+	NVGtessWorker workers[NVG_TESS_THREADS];
+	bx::Semaphore start;
+	bx::Semaphore done;
+	NVGcontext* ctx;
+	int32_t next;
+	int quit;
+};
+typedef struct NVGtessPool NVGtessPool;
+
+static int32_t nvg__tessThread(bx::Thread* self, void* userData)
+{
+	NVGtessWorker* worker = (NVGtessWorker*)userData;
+	NVGtessPool* pool = worker->pool;
+	NVG_NOTUSED(self);
+
+	for (;;) {
+		pool->start.wait();
+		if (pool->quit)
+			break;
+		nvg__runDeferred(pool->ctx, worker->tess, &pool->next);
+		pool->done.post();
+	}
+	return 0;
+}
+
+static void nvg__deleteTessPool(NVGcontext* ctx, NVGtessPool* pool)
+{
+	int i;
+	if (pool == NULL) return;
+
+	pool->quit = 1;
+	pool->start.post(NVG_TESS_THREADS);
+	for (i = 0; i < NVG_TESS_THREADS; i++) {
+		pool->workers[i].thread.shutdown();
+		nvg__deleteTessContext(ctx->params.allocator, pool->workers[i].tess);
+	}
+	BX_DELETE(ctx->params.allocator, pool);
+}
+
+static NVGtessPool* nvg__createTessPool(NVGcontext* ctx)
+{
+	int i;
+	NVGtessPool* pool = BX_NEW(ctx->params.allocator, NVGtessPool);
+	if (pool == NULL) return NULL;
+
+	pool->ctx = ctx;
+	pool->next = 0;
+	pool->quit = 0;
+	for (i = 0; i < NVG_TESS_THREADS; i++) {
+		pool->workers[i].pool = pool;
+		pool->workers[i].tess = nvg__createTessContext(ctx);
+	}
+	for (i = 0; i < NVG_TESS_THREADS; i++) {
+		if (pool->workers[i].tess == NULL) {
+			nvg__deleteTessPool(ctx, pool);
+			return NULL;
+		}
+	}
+	for (i = 0; i < NVG_TESS_THREADS; i++)
+		pool->workers[i].thread.init(nvg__tessThread, &pool->workers[i], 0, "nanovg");
+	return pool;
+}
+
+#endif // NVG_TESS_THREADS > 0
+
+static int nvg__deferCall(NVGcontext* ctx, int type, NVGpaint* paint, float strokeWidth)
+{
+	NVGstate* state = nvg__getState(ctx);
+	NVGdeferredCall* call;
+	int sharesPath, ncommands;
+
+	// Keeps the vertices of a batch in cache, calls drawing the same path stay in one batch.
+	if (ctx->ndeferred >= NVG_TESS_MAX_BATCH && ctx->deferredPath != ctx->ndeferred-1)
+		nvg__flushDeferred(ctx);
+	sharesPath = ctx->deferredPath >= 0 && ctx->deferredPath == ctx->ndeferred-1;
+	ncommands = sharesPath ? 0 : ctx->ncommands;
+
+	if (ctx->ndeferred+1 > ctx->cdeferred) {
+		int cdeferred = nvg__maxi(ctx->ndeferred+1, ctx->cdeferred*2);
+		NVGdeferredCall* deferred = (NVGdeferredCall*)BX_REALLOC(ctx->params.allocator, ctx->deferred, sizeof(NVGdeferredCall)*cdeferred);
+		if (deferred == NULL) goto error;
+		ctx->deferred = deferred;
+		ctx->cdeferred = cdeferred;
+	}
+	if (ctx->ndeferredCommands+ncommands > ctx->cdeferredCommands) {
+		int ccommands = nvg__maxi(ctx->ndeferredCommands+ncommands, ctx->cdeferredCommands*2);
+		float* commands = (float*)BX_REALLOC(ctx->params.allocator, ctx->deferredCommands, sizeof(float)*ccommands);
+		if (commands == NULL) goto error;
+		ctx->deferredCommands = commands;
+		ctx->cdeferredCommands = ccommands;
+	}
+
+	call = &ctx->deferred[ctx->ndeferred];
+	call->type = type;
+	call->paint = *paint;
+	call->compositeOperation = state->compositeOperation;
+	call->scissor = state->scissor;
+	call->strokeWidth = strokeWidth;
+	call->lineCap = state->lineCap;
+	call->lineJoin = state->lineJoin;
+	call->miterLimit = state->miterLimit;
+	call->antiAlias = ctx->params.edgeAntiAlias && state->shapeAntiAlias;
+	call->firstCommand = sharesPath ? call[-1].firstCommand : ctx->ndeferredCommands;
+	call->ncommands = sharesPath ? call[-1].ncommands : ncommands;
+	call->sharesPath = sharesPath;
+	call->output = NULL;
+	call->recorded = -1;
+
+	memcpy(&ctx->deferredCommands[ctx->ndeferredCommands], ctx->commands, sizeof(float)*ncommands);
+	ctx->ndeferredCommands += ncommands;
+	ctx->deferredPath = ctx->ndeferred++;
+	return 1;
+
+error:
+	// Drawn right away, after the calls before it.
+	nvg__flushDeferred(ctx);
+	return 0;
+}
+
+static void nvg__deleteDeferred(NVGcontext* ctx)
+{
+	bx::AllocatorI* allocator = ctx->params.allocator;
+
+#if NVG_TESS_THREADS > 0
+	nvg__deleteTessPool(ctx, ctx->tessPool);
+#endif
+	nvg__deleteTessContext(allocator, ctx->tess);
+	if (ctx->deferred != NULL) BX_FREE(allocator, ctx->deferred);
+	if (ctx->deferredCommands != NULL) BX_FREE(allocator, ctx->deferredCommands);
+}
+
+static void nvg__flushDeferred(NVGcontext* ctx)
+{
+	int32_t next = 0;
+	const NVGpath* paths;
+	int i, j;
+
+	if (ctx->ndeferred == 0)
+		return;
+
+#if NVG_TESS_THREADS > 0
+	if (ctx->tessPool != NULL && ctx->ndeferred >= NVG_TESS_BATCH) {
+		NVGtessPool* pool = ctx->tessPool;
+		pool->next = 0;
+		pool->start.post(NVG_TESS_THREADS);
+		nvg__runDeferred(ctx, ctx->tess, &pool->next);
+		for (i = 0; i < NVG_TESS_THREADS; i++)
+			pool->done.wait();
+	} else
+#endif
+	{
+		nvg__runDeferred(ctx, ctx->tess, &next);
+	}
+
+	// Submit in drawing order, the paths of each call are ranges of the output it was tessellated into.
+	for (i = 0; i < ctx->ndeferred; i++) {
+		NVGdeferredCall* call = &ctx->deferred[i];
+		NVGrecordedCall* tessellated;
+		if (call->recorded < 0)
+			continue;
+		tessellated = &call->output->calls[call->recorded];
+		paths = nvg__replayPaths(ctx, call->output, tessellated, NULL);
+		if (paths == NULL && tessellated->npaths > 0)
+			continue;
+		if (call->type == NVG_DEFERRED_FILL) {
+			nvg__submitFill(ctx, &call->paint, call->compositeOperation, &call->scissor, ctx->fringeWidth,
+							tessellated->bounds, paths, tessellated->npaths);
+			for (j = 0; j < tessellated->npaths; j++) {
+				ctx->fillTriCount += paths[j].nfill-2;
+				ctx->fillTriCount += paths[j].nstroke-2;
+				ctx->drawCallCount += 2;
+			}
+		} else {
+			nvg__submitStroke(ctx, &call->paint, call->compositeOperation, &call->scissor, ctx->fringeWidth,
+							  call->strokeWidth, paths, tessellated->npaths);
+			for (j = 0; j < tessellated->npaths; j++) {
+				ctx->strokeTriCount += paths[j].nstroke-2;
+				ctx->drawCallCount++;
+			}
+		}
+	}
+
+	ctx->ndeferred = 0;
+	ctx->ndeferredCommands = 0;
+	ctx->deferredPath = -1;
+}
+
+void nvgDeferTessellation(NVGcontext* ctx, int defer)
+{
+	if (!defer) {
+		nvg__flushDeferred(ctx);
+		ctx->deferTessellation = 0;
+		return;
+	}
+
+	if (ctx->tess == NULL) {
+		ctx->tess = nvg__createTessContext(ctx);
+		if (ctx->tess == NULL) return;
+	}
+#if NVG_TESS_THREADS > 0
+	if (ctx->tessPool == NULL)
+		ctx->tessPool = nvg__createTessPool(ctx);
+#endif
+	ctx->deferTessellation = 1;
+}
+
+// Returns 1 when the path, grown by 'expand' around its points, is outside of the view and scissor.
+// Curves are within the hull of their control points, so the test is conservative.
+static int nvg__cullPath(NVGcontext* ctx, NVGstate* state, float expand)
+{
+	const float* commands = ctx->commands;
+	float minx = 1e6f, miny = 1e6f, maxx = -1e6f, maxy = -1e6f;
+	float vx0 = 0.0f, vy0 = 0.0f, vx1 = ctx->viewWidth, vy1 = ctx->viewHeight;
+	int i = 0, j, npts;
+
+	// Display lists may be replayed where the path is visible.
+	if (ctx->recording != NULL)
+		return 0;
+
+	if (state->scissor.extent[0] >= 0.0f) {
+		const float* t = state->scissor.xform;
+		float ex = nvg__absf(t[0])*state->scissor.extent[0] + nvg__absf(t[2])*state->scissor.extent[1];
+		float ey = nvg__absf(t[1])*state->scissor.extent[0] + nvg__absf(t[3])*state->scissor.extent[1];
+		vx0 = nvg__maxf(vx0, t[4] - ex);
+		vy0 = nvg__maxf(vy0, t[5] - ey);
+		vx1 = nvg__minf(vx1, t[4] + ex);
+		vy1 = nvg__minf(vy1, t[5] + ey);
+	}
+	vx0 -= expand;
+	vy0 -= expand;
+	vx1 += expand;
+	vy1 += expand;
+
+	while (i < ctx->ncommands) {
+		switch ((int)commands[i]) {
+		case NVG_MOVETO:
+		case NVG_LINETO:
+			npts = 1;
+			break;
+		case NVG_BEZIERTO:
+			npts = 3;
+			break;
+		case NVG_WINDING:
+			i += 2;
+			continue;
+		default:
+			i++;
+			continue;
+		}
+		for (j = 0; j < npts; j++) {
+			float x = commands[i+1+j*2], y = commands[i+2+j*2];
+			// Most drawn paths have a point in view, stop at the first one.
+			if (x >= vx0 && x <= vx1 && y >= vy0 && y <= vy1)
+				return 0;
+			minx = nvg__minf(minx, x);
+			miny = nvg__minf(miny, y);
+			maxx = nvg__maxf(maxx, x);
+			maxy = nvg__maxf(maxy, y);
+		}
+		i += 1 + npts*2;
+	}
+
+	return minx > vx1 || maxx < vx0 || miny > vy1 || maxy < vy0;
+}
+
+void nvgFill(NVGcontext* ctx)
+{
+	NVGstate* state = nvg__getState(ctx);
+	const NVGpath* path;
+	NVGpaint fillPaint = state->fill;
+	int i;
+
+	// Apply global alpha
 	fillPaint.innerColor.a *= state->alpha;
 	fillPaint.outerColor.a *= state->alpha;
 
-	ctx->params.renderFill(ctx->params.userPtr, &fillPaint, state->compositeOperation, &state->scissor, ctx->fringeWidth,
-						   ctx->cache->bounds, ctx->cache->paths, ctx->cache->npaths);
+	// The anti-aliasing fringe is mitered with a limit of 2.4 on the outside.
+	if (nvg__cullPath(ctx, state, ctx->fringeWidth*1.2f)) {
+		ctx->culledShapeCount++;
+		return;
+	}
+	ctx->shapeCount++;
+
+	if (ctx->deferTessellation && nvg__deferCall(ctx, NVG_DEFERRED_FILL, &fillPaint, 0.0f))
+		return;
+
+	nvg__flattenPaths(ctx);
+	if (ctx->params.edgeAntiAlias && state->shapeAntiAlias)
+		nvg__expandFill(ctx, ctx->fringeWidth, NVG_MITER, 2.4f);
+	else
+		nvg__expandFill(ctx, 0.0f, NVG_MITER, 2.4f);
+
+	nvg__submitFill(ctx, &fillPaint, state->compositeOperation, &state->scissor, ctx->fringeWidth,
+					ctx->cache->bounds, ctx->cache->paths, ctx->cache->npaths);
 
 	// Count triangles
 	for (i = 0; i < ctx->cache->npaths; i++) {
@@ -2256,7 +3708,7 @@ void nvgFill(NVGcontext* ctx)
 void nvgStroke(NVGcontext* ctx)
 {
 	NVGstate* state = nvg__getState(ctx);
-	float scale = nvg__getAverageScale(state->xform);
+	float scale = nvg__getStateScale(state);
 	float strokeWidth = nvg__clampf(state->strokeWidth * scale, 0.0f, 200.0f);
 	NVGpaint strokePaint = state->stroke;
 	const NVGpath* path;
@@ -2276,6 +3728,16 @@ void nvgStroke(NVGcontext* ctx)
 	strokePaint.innerColor.a *= state->alpha;
 	strokePaint.outerColor.a *= state->alpha;
 
+	// Miter joins reach out up to the miter limit, square caps by sqrt(2) of the half width.
+	if (nvg__cullPath(ctx, state, strokeWidth*0.5f*(state->lineJoin == NVG_MITER ? nvg__maxf(state->miterLimit, 1.5f) : 1.5f) + ctx->fringeWidth)) {
+		ctx->culledShapeCount++;
+		return;
+	}
+	ctx->shapeCount++;
+
+	if (ctx->deferTessellation && nvg__deferCall(ctx, NVG_DEFERRED_STROKE, &strokePaint, strokeWidth))
+		return;
+
 	nvg__flattenPaths(ctx);
 
 	if (ctx->params.edgeAntiAlias && state->shapeAntiAlias)
@@ -2283,8 +3745,8 @@ void nvgStroke(NVGcontext* ctx)
 	else
 		nvg__expandStroke(ctx, strokeWidth*0.5f, 0.0f, state->lineCap, state->lineJoin, state->miterLimit);
 
-	ctx->params.renderStroke(ctx->params.userPtr, &strokePaint, state->compositeOperation, &state->scissor, ctx->fringeWidth,
-							 strokeWidth, ctx->cache->paths, ctx->cache->npaths);
+	nvg__submitStroke(ctx, &strokePaint, state->compositeOperation, &state->scissor, ctx->fringeWidth,
+					  strokeWidth, ctx->cache->paths, ctx->cache->npaths);
 
 	// Count triangles
 	for (i = 0; i < ctx->cache->npaths; i++) {
@@ -2294,14 +3756,38 @@ void nvgStroke(NVGcontext* ctx)
 	}
 }
 
+void nvgCullStats(NVGcontext* ctx, int* culled, int* drawn)
+{
+	if (culled)
+		*culled = ctx->culledShapeCount;
+	if (drawn)
+		*drawn = ctx->shapeCount;
+}
+
+static void nvg__clearTextCache(NVGcontext* ctx)
+{
+	int i;
+	if (ctx->textCache == NULL) return;
+	for (i = 0; i < NVG_TEXT_CACHE_SIZE; i++)
+		ctx->textCache[i].key.type = NVG_TEXT_CACHE_NONE;
+}
+
 // Add fonts
 int nvgCreateFont(NVGcontext* ctx, const char* name, const char* path)
 {
+	nvg__clearTextCache(ctx);
 	return fonsAddFont(ctx->fs, name, path);
 }
 
+int nvgCreateFontMapped(NVGcontext* ctx, const char* name, const char* path)
+{
+	nvg__clearTextCache(ctx);
+	return fonsAddFontMapped(ctx->fs, name, path);
+}
+
 int nvgCreateFontMem(NVGcontext* ctx, const char* name, unsigned char* data, int ndata, int freeData)
 {
+	nvg__clearTextCache(ctx);
 	return fonsAddFontMem(ctx->fs, name, data, ndata, freeData);
 }
 
@@ -2315,6 +3801,8 @@ int nvgFindFont(NVGcontext* ctx, const char* name)
 int nvgAddFallbackFontId(NVGcontext* ctx, int baseFont, int fallbackFont)
 {
 	if(baseFont == -1 || fallbackFont == -1) return 0;
+	// Glyphs missing from the base font may now be measured differently.
+	nvg__clearTextCache(ctx);
 	return fonsAddFallbackFont(ctx->fs, baseFont, fallbackFont);
 }
 
@@ -2326,43 +3814,48 @@ int nvgAddFallbackFont(NVGcontext* ctx, const char* baseFont, const char* fallba
 // State setting
 void nvgFontSize(NVGcontext* ctx, float size)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__editState(ctx, 1 << NVG_STATE_TEXT);
 	state->fontSize = size;
 }
 
 void nvgFontBlur(NVGcontext* ctx, float blur)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__editState(ctx, 1 << NVG_STATE_TEXT);
 	state->fontBlur = blur;
 }
 
 void nvgTextLetterSpacing(NVGcontext* ctx, float spacing)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__editState(ctx, 1 << NVG_STATE_TEXT);
 	state->letterSpacing = spacing;
 }
 
 void nvgTextLineHeight(NVGcontext* ctx, float lineHeight)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__editState(ctx, 1 << NVG_STATE_TEXT);
 	state->lineHeight = lineHeight;
 }
 
 void nvgTextAlign(NVGcontext* ctx, int align)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__editState(ctx, 1 << NVG_STATE_TEXT);
 	state->textAlign = align;
 }
 
+void nvgFontSizeQuantization(NVGcontext* ctx, float step)
+{
+	ctx->fontSizeStep = nvg__maxf(step, 0.0f);
+}
+
 void nvgFontFaceId(NVGcontext* ctx, int font)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__editState(ctx, 1 << NVG_STATE_TEXT);
 	state->fontId = font;
 }
 
 void nvgFontFace(NVGcontext* ctx, const char* font)
 {
-	NVGstate* state = nvg__getState(ctx);
+	NVGstate* state = nvg__editState(ctx, 1 << NVG_STATE_TEXT);
 	state->fontId = fonsGetFontByName(ctx->fs, font);
 }
 
@@ -2373,7 +3866,23 @@ static float nvg__quantize(float a, float d)
 
 static float nvg__getFontScale(NVGstate* state)
 {
-	return nvg__minf(nvg__quantize(nvg__getAverageScale(state->xform), 0.01f), 4.0f);
+	return nvg__minf(nvg__quantize(nvg__getStateScale(state), 0.01f), 4.0f);
+}
+
+// Scale from text space to font pixels, keeping the font pixel size on the quantization grid.
+static float nvg__textScaleFor(NVGcontext* ctx, NVGstate* state, float devicePxRatio)
+{
+	float scale = nvg__getFontScale(state) * devicePxRatio;
+	float size;
+	if (ctx->fontSizeStep <= 0.0f || state->fontSize <= 0.0f)
+		return scale;
+	size = nvg__maxf(nvg__quantize(state->fontSize * scale, ctx->fontSizeStep), ctx->fontSizeStep);
+	return size / state->fontSize;
+}
+
+static float nvg__getTextScale(NVGcontext* ctx, NVGstate* state)
+{
+	return nvg__textScaleFor(ctx, state, ctx->devicePxRatio);
 }
 
 static void nvg__flushTextTexture(NVGcontext* ctx)
@@ -2415,10 +3924,150 @@ static int nvg__allocTextAtlas(NVGcontext* ctx)
 		ctx->fontImages[ctx->fontImageIdx+1] = ctx->params.renderCreateTexture(ctx->params.userPtr, NVG_TEXTURE_ALPHA, iw, ih, 0, NULL);
 	}
 	++ctx->fontImageIdx;
-	fonsResetAtlas(ctx->fs, iw, ih);
+	fonsEvictAtlas(ctx->fs, iw, ih, NVG_MAX_GLYPH_AGE);
+	ctx->fontAtlasGeneration++;
 	return 1;
 }
 
+static void nvg__compactTextAtlas(NVGcontext* ctx)
+{
+	FONSatlasStats stats;
+	int images[NVG_MAX_FONTIMAGES];
+	int i, j, nimages = 0, iw = NVG_INIT_FONTIMAGE_SIZE, ih = NVG_INIT_FONTIMAGE_SIZE;
+	int fontImage = 0;
+
+	if (ctx->fontImageIdx != 0 || ctx->fontImages[0] == 0)
+		return;
+
+	fonsGetAtlasStats(ctx->fs, NVG_MAX_GLYPH_AGE, &stats);
+
+	// Find the smallest font image which keeps live glyphs under half of it.
+	while (iw*ih < stats.liveArea*2 && (iw < NVG_MAX_FONTIMAGE_SIZE || ih < NVG_MAX_FONTIMAGE_SIZE)) {
+		if (iw > ih)
+			ih *= 2;
+		else
+			iw *= 2;
+	}
+	if (iw*ih >= stats.width*stats.height) {
+		// Repack in place only when the atlas is getting full and most of it is wasted.
+		if (stats.fragmentation < NVG_MAX_FONTIMAGE_FRAGMENTATION || stats.allocatedArea < stats.width*stats.height/2)
+			return;
+		iw = stats.width;
+		ih = stats.height;
+	}
+
+	// Reuse a spare font image of the right size, the current one is still used by this frame.
+	for (i = 0; i < NVG_MAX_FONTIMAGES; i++) {
+		int nw, nh;
+		if (ctx->fontImages[i] == 0)
+			continue;
+		nvgImageSize(ctx, ctx->fontImages[i], &nw, &nh);
+		if (i > 0 && fontImage == 0 && nw == iw && nh == ih)
+			fontImage = ctx->fontImages[i];
+		else
+			images[nimages++] = ctx->fontImages[i];
+	}
+	if (fontImage == 0)
+		fontImage = ctx->params.renderCreateTexture(ctx->params.userPtr, NVG_TEXTURE_ALPHA, iw, ih, 0, NULL);
+	if (fontImage == 0)
+		return;
+
+	// Keep images of the same size as spares, delete the others.
+	ctx->fontImages[0] = fontImage;
+	for (i = 0, j = 1; i < nimages; i++) {
+		int nw, nh;
+		nvgImageSize(ctx, images[i], &nw, &nh);
+		if (nw == iw && nh == ih && j < NVG_MAX_FONTIMAGES)
+			ctx->fontImages[j++] = images[i];
+		else
+			nvgDeleteImage(ctx, images[i]);
+	}
+	for (; j < NVG_MAX_FONTIMAGES; j++)
+		ctx->fontImages[j] = 0;
+
+	// Repack live glyphs into the new image and upload it once.
+	fonsEvictAtlas(ctx->fs, iw, ih, NVG_MAX_GLYPH_AGE);
+	ctx->fontAtlasGeneration++;
+	nvg__flushTextTexture(ctx);
+}
+
+void nvgTextAtlasStats(NVGcontext* ctx, float* occupancy, float* fragmentation)
+{
+	FONSatlasStats stats;
+	fonsGetAtlasStats(ctx->fs, NVG_MAX_GLYPH_AGE, &stats);
+	if (occupancy)
+		*occupancy = stats.occupancy;
+	if (fragmentation)
+		*fragmentation = stats.fragmentation;
+}
+
+int nvgSaveTextAtlas(NVGcontext* ctx, const char* path)
+{
+	return fonsSaveAtlasCache(ctx->fs, path);
+}
+
+int nvgLoadTextAtlas(NVGcontext* ctx, const char* path)
+{
+	int i, iw, ih, w = 0, h = 0, fontImage, nglyphs;
+
+	nvg__flushTextTexture(ctx);
+	nvgImageSize(ctx, ctx->fontImages[ctx->fontImageIdx], &iw, &ih);
+
+	nglyphs = fonsLoadAtlasCache(ctx->fs, path);
+	ctx->fontAtlasGeneration++;
+
+	// The cached atlas may have a different size, start over with a single font image.
+	fonsGetAtlasSize(ctx->fs, &w, &h);
+	if (w != iw || h != ih) {
+		fontImage = nglyphs > 0 ? ctx->params.renderCreateTexture(ctx->params.userPtr, NVG_TEXTURE_ALPHA, w, h, 0, NULL) : 0;
+		if (fontImage == 0) {
+			fonsResetAtlas(ctx->fs, iw, ih);
+			return 0;
+		}
+		for (i = 0; i < NVG_MAX_FONTIMAGES; i++) {
+			if (ctx->fontImages[i] != 0)
+				nvgDeleteImage(ctx, ctx->fontImages[i]);
+			ctx->fontImages[i] = 0;
+		}
+		ctx->fontImages[0] = fontImage;
+		ctx->fontImageIdx = 0;
+	}
+
+	nvg__flushTextTexture(ctx);
+	return nglyphs;
+}
+
+// Large text is filled from glyph outlines, which keeps it sharp and out of the atlas.
+static int nvg__useTextOutlines(NVGstate* state, float scale)
+{
+#ifdef FONS_USE_FREETYPE
+	NVG_NOTUSED(state);
+	NVG_NOTUSED(scale);
+	return 0; // Outlines are only read through stb_truetype.
+#else
+	return state->fontBlur <= 0.0f && state->fontSize*scale >= NVG_MIN_OUTLINE_FONT_SIZE;
+#endif
+}
+
+int nvgTextPrewarm(NVGcontext* ctx, float devicePixelRatio, const char* string, const char* end)
+{
+	NVGstate* state = nvg__getState(ctx);
+	float scale = nvg__textScaleFor(ctx, state, devicePixelRatio);
+	int missing;
+
+	if (state->fontId == FONS_INVALID) return 0;
+	if (nvg__useTextOutlines(state, scale)) return 0;
+
+	fonsSetSize(ctx->fs, state->fontSize*scale);
+	fonsSetBlur(ctx->fs, state->fontBlur*scale);
+	fonsSetFont(ctx->fs, state->fontId);
+
+	missing = fonsPrewarmText(ctx->fs, string, end);
+	if (missing > 0 && nvg__allocTextAtlas(ctx))
+		missing = fonsPrewarmText(ctx->fs, string, end);
+	return missing;
+}
+
 static void nvg__renderText(NVGcontext* ctx, NVGvertex* verts, int nverts)
 {
 	NVGstate* state = nvg__getState(ctx);
@@ -2431,19 +4080,85 @@ static void nvg__renderText(NVGcontext* ctx, NVGvertex* verts, int nverts)
 	paint.innerColor.a *= state->alpha;
 	paint.outerColor.a *= state->alpha;
 
-	ctx->params.renderTriangles(ctx->params.userPtr, &paint, state->compositeOperation, &state->scissor, verts, nverts);
+	nvg__flushDeferred(ctx);
+	nvg__submitTriangles(ctx, &paint, state->compositeOperation, &state->scissor, verts, nverts);
 
 	ctx->drawCallCount++;
 	ctx->textTriCount += nverts/3;
 }
 
+static float nvg__textOutlines(NVGcontext* ctx, float x, float y, const char* string, const char* end, float scale)
+{
+	float invscale = 1.0f / scale;
+	float* commands = ctx->commands;
+	int ccommands = ctx->ccommands;
+	int ncommands = ctx->ncommands;
+	float commandx = ctx->commandx, commandy = ctx->commandy;
+	FONStextIter iter;
+	FONSquad q;
+
+	// Fill the glyphs as a path of their own, leaving the one being built untouched.
+	ctx->commands = ctx->textCommands;
+	ctx->ccommands = ctx->ctextCommands;
+	ctx->ncommands = 0;
+	nvg__clearPathCache(ctx);
+
+	fonsTextIterInit(ctx->fs, &iter, x*scale, y*scale, string, end, FONS_GLYPH_BITMAP_OPTIONAL);
+	while (fonsTextIterNext(ctx->fs, &iter, &q)) {
+		const float* outline;
+		int i = 0, n = fonsTextIterOutline(ctx->fs, &iter, &outline);
+		while (i < n) {
+			switch ((int)outline[i]) {
+			case FONS_OUTLINE_MOVETO:
+				nvgMoveTo(ctx, outline[i+1]*invscale, outline[i+2]*invscale);
+				i += 3;
+				break;
+			case FONS_OUTLINE_LINETO:
+				nvgLineTo(ctx, outline[i+1]*invscale, outline[i+2]*invscale);
+				i += 3;
+				break;
+			case FONS_OUTLINE_QUADTO:
+				nvgQuadTo(ctx, outline[i+1]*invscale, outline[i+2]*invscale, outline[i+3]*invscale, outline[i+4]*invscale);
+				i += 5;
+				break;
+			case FONS_OUTLINE_CUBICTO:
+				nvgBezierTo(ctx, outline[i+1]*invscale, outline[i+2]*invscale, outline[i+3]*invscale, outline[i+4]*invscale,
+							outline[i+5]*invscale, outline[i+6]*invscale);
+				i += 7;
+				break;
+			case FONS_OUTLINE_CLOSE:
+				nvgClosePath(ctx);
+				nvgPathWinding(ctx, outline[i+1] != 0.0f ? NVG_HOLE : NVG_SOLID);
+				i += 2;
+				break;
+			default:
+				i = n;
+				break;
+			}
+		}
+	}
+	if (ctx->ncommands > 0)
+		nvgFill(ctx);
+
+	ctx->textCommands = ctx->commands;
+	ctx->ctextCommands = ctx->ccommands;
+	ctx->commands = commands;
+	ctx->ccommands = ccommands;
+	ctx->ncommands = ncommands;
+	ctx->commandx = commandx;
+	ctx->commandy = commandy;
+	nvg__clearPathCache(ctx);
+
+	return iter.nextx / scale;
+}
+
 float nvgText(NVGcontext* ctx, float x, float y, const char* string, const char* end)
 {
 	NVGstate* state = nvg__getState(ctx);
 	FONStextIter iter, prevIter;
 	FONSquad q;
 	NVGvertex* verts;
-	float scale = nvg__getFontScale(state) * ctx->devicePxRatio;
+	float scale = nvg__getTextScale(ctx, state);
 	float invscale = 1.0f / scale;
 	int cverts = 0;
 	int nverts = 0;
@@ -2459,6 +4174,9 @@ float nvgText(NVGcontext* ctx, float x, float y, const char* string, const char*
 	fonsSetAlign(ctx->fs, state->textAlign);
 	fonsSetFont(ctx->fs, state->fontId);
 
+	if (nvg__useTextOutlines(state, scale))
+		return nvg__textOutlines(ctx, x, y, string, end, scale);
+
 	cverts = nvg__maxi(2, (int)(end - string)) * 6; // conservative estimate.
 	verts = nvg__allocTempVerts(ctx, cverts);
 	if (verts == NULL) return x;
@@ -2518,6 +4236,7 @@ void nvgTextBox(NVGcontext* ctx, float x, float y, float breakRowWidth, const ch
 
 	nvgTextMetrics(ctx, NULL, NULL, &lineh);
 
+	nvg__editState(ctx, 1 << NVG_STATE_TEXT);
 	state->textAlign = NVG_ALIGN_LEFT | valign;
 
 	while ((nrows = nvgTextBreakLines(ctx, string, end, breakRowWidth, rows, 2))) {
@@ -2537,10 +4256,93 @@ void nvgTextBox(NVGcontext* ctx, float x, float y, float breakRowWidth, const ch
 	state->textAlign = oldAlign;
 }
 
-int nvgTextGlyphPositions(NVGcontext* ctx, float x, float y, const char* string, const char* end, NVGglyphPosition* positions, int maxPositions)
+static unsigned int nvg__hashBytes(unsigned int h, const void* data, int size)
+{
+	const unsigned char* p = (const unsigned char*)data;
+	int i;
+	// FNV-1a
+	for (i = 0; i < size; i++) {
+		h ^= p[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+// Returns the cache slot for measuring the string with the current text state, or NULL when it can not be cached.
+static NVGtextCacheEntry* nvg__findTextCache(NVGcontext* ctx, NVGtextCacheKey* key, int type, float x, float y, float breakRowWidth, const char* string, const char* end)
+{
+	NVGstate* state = nvg__getState(ctx);
+	unsigned int h;
+
+	if (state->fontId == FONS_INVALID || end - string > NVG_TEXT_CACHE_MAX_LEN)
+		return NULL;
+
+	if (ctx->textCache == NULL) {
+		ctx->textCache = (NVGtextCacheEntry*)BX_ALLOC(ctx->params.allocator, sizeof(NVGtextCacheEntry) * NVG_TEXT_CACHE_SIZE);
+		if (ctx->textCache == NULL) return NULL;
+		memset(ctx->textCache, 0, sizeof(NVGtextCacheEntry) * NVG_TEXT_CACHE_SIZE);
+	}
+
+	memset(key, 0, sizeof(NVGtextCacheKey));
+	key->type = type;
+	key->font = state->fontId;
+	key->size = state->fontSize;
+	key->spacing = state->letterSpacing;
+	key->blur = state->fontBlur;
+	key->scale = nvg__getTextScale(ctx, state);
+	key->align = state->textAlign;
+	key->x = x;
+	key->y = y;
+	key->breakRowWidth = breakRowWidth;
+	key->len = (int)(end - string);
+	key->hash = nvg__hashBytes(2166136261u, string, key->len);
+
+	h = nvg__hashBytes(key->hash, key, sizeof(NVGtextCacheKey));
+	return &ctx->textCache[h & (NVG_TEXT_CACHE_SIZE-1)];
+}
+
+static int nvg__textCacheHit(NVGcontext* ctx, const NVGtextCacheEntry* entry, const NVGtextCacheKey* key, const char* string, int maxCount)
+{
+	int hit = memcmp(&entry->key, key, sizeof(NVGtextCacheKey)) == 0 &&
+			  memcmp(entry->str, string, key->len) == 0 &&
+			  (entry->count < entry->limit || maxCount <= entry->count);
+	if (hit)
+		ctx->textCacheHits++;
+	else
+		ctx->textCacheMisses++;
+	return hit;
+}
+
+static int nvg__storeTextCache(NVGcontext* ctx, NVGtextCacheEntry* entry, const NVGtextCacheKey* key, const char* string, int count, int limit, int itemSize)
+{
+	if (count*itemSize > entry->citems) {
+		void* items = BX_REALLOC(ctx->params.allocator, entry->items, count*itemSize);
+		if (items == NULL) {
+			entry->key.type = NVG_TEXT_CACHE_NONE;
+			return 0;
+		}
+		entry->items = items;
+		entry->citems = count*itemSize;
+	}
+	entry->key = *key;
+	memcpy(entry->str, string, key->len);
+	entry->count = count;
+	entry->limit = limit;
+	return 1;
+}
+
+void nvgTextCacheStats(NVGcontext* ctx, int* hits, int* misses)
+{
+	if (hits)
+		*hits = ctx->textCacheHits;
+	if (misses)
+		*misses = ctx->textCacheMisses;
+}
+
+static int nvg__textGlyphPositions(NVGcontext* ctx, float x, float y, const char* string, const char* end, NVGglyphPosition* positions, int maxPositions)
 {
 	NVGstate* state = nvg__getState(ctx);
-	float scale = nvg__getFontScale(state) * ctx->devicePxRatio;
+	float scale = nvg__getTextScale(ctx, state);
 	float invscale = 1.0f / scale;
 	FONStextIter iter, prevIter;
 	FONSquad q;
@@ -2580,6 +4382,44 @@ int nvgTextGlyphPositions(NVGcontext* ctx, float x, float y, const char* string,
 	return npos;
 }
 
+int nvgTextGlyphPositions(NVGcontext* ctx, float x, float y, const char* string, const char* end, NVGglyphPosition* positions, int maxPositions)
+{
+	NVGtextCacheKey key;
+	NVGtextCacheEntry* entry;
+	NVGcachedPosition* cached;
+	int i, npos;
+
+	if (end == NULL)
+		end = string + strlen(string);
+
+	entry = nvg__findTextCache(ctx, &key, NVG_TEXT_CACHE_POSITIONS, x, y, 0, string, end);
+	if (entry != NULL && nvg__textCacheHit(ctx, entry, &key, string, maxPositions)) {
+		npos = nvg__mini(entry->count, maxPositions);
+		cached = (NVGcachedPosition*)entry->items;
+		for (i = 0; i < npos; i++) {
+			positions[i].str = string + cached[i].str;
+			positions[i].x = cached[i].x;
+			positions[i].minx = cached[i].minx;
+			positions[i].maxx = cached[i].maxx;
+		}
+		return npos;
+	}
+
+	npos = nvg__textGlyphPositions(ctx, x, y, string, end, positions, maxPositions);
+
+	if (entry != NULL && nvg__storeTextCache(ctx, entry, &key, string, npos, maxPositions, sizeof(NVGcachedPosition))) {
+		cached = (NVGcachedPosition*)entry->items;
+		for (i = 0; i < npos; i++) {
+			cached[i].str = (int)(positions[i].str - string);
+			cached[i].x = positions[i].x;
+			cached[i].minx = positions[i].minx;
+			cached[i].maxx = positions[i].maxx;
+		}
+	}
+
+	return npos;
+}
+
 enum NVGcodepointType {
 	NVG_SPACE,
 	NVG_NEWLINE,
@@ -2587,10 +4427,10 @@ enum NVGcodepointType {
 	NVG_CJK_CHAR,
 };
 
-int nvgTextBreakLines(NVGcontext* ctx, const char* string, const char* end, float breakRowWidth, NVGtextRow* rows, int maxRows)
+static int nvg__textBreakLines(NVGcontext* ctx, const char* string, const char* end, float breakRowWidth, NVGtextRow* rows, int maxRows)
 {
 	NVGstate* state = nvg__getState(ctx);
-	float scale = nvg__getFontScale(state) * ctx->devicePxRatio;
+	float scale = nvg__getTextScale(ctx, state);
 	float invscale = 1.0f / scale;
 	FONStextIter iter, prevIter;
 	FONSquad q;
@@ -2793,10 +4633,52 @@ int nvgTextBreakLines(NVGcontext* ctx, const char* string, const char* end, floa
 	return nrows;
 }
 
-float nvgTextBounds(NVGcontext* ctx, float x, float y, const char* string, const char* end, float* bounds)
+int nvgTextBreakLines(NVGcontext* ctx, const char* string, const char* end, float breakRowWidth, NVGtextRow* rows, int maxRows)
+{
+	NVGtextCacheKey key;
+	NVGtextCacheEntry* entry;
+	NVGcachedRow* cached;
+	int i, nrows;
+
+	if (end == NULL)
+		end = string + strlen(string);
+
+	entry = nvg__findTextCache(ctx, &key, NVG_TEXT_CACHE_ROWS, 0, 0, breakRowWidth, string, end);
+	if (entry != NULL && nvg__textCacheHit(ctx, entry, &key, string, maxRows)) {
+		nrows = nvg__mini(entry->count, maxRows);
+		cached = (NVGcachedRow*)entry->items;
+		for (i = 0; i < nrows; i++) {
+			rows[i].start = string + cached[i].start;
+			rows[i].end = string + cached[i].end;
+			rows[i].next = string + cached[i].next;
+			rows[i].width = cached[i].width;
+			rows[i].minx = cached[i].minx;
+			rows[i].maxx = cached[i].maxx;
+		}
+		return nrows;
+	}
+
+	nrows = nvg__textBreakLines(ctx, string, end, breakRowWidth, rows, maxRows);
+
+	if (entry != NULL && nvg__storeTextCache(ctx, entry, &key, string, nrows, maxRows, sizeof(NVGcachedRow))) {
+		cached = (NVGcachedRow*)entry->items;
+		for (i = 0; i < nrows; i++) {
+			cached[i].start = (int)(rows[i].start - string);
+			cached[i].end = (int)(rows[i].end - string);
+			cached[i].next = (int)(rows[i].next - string);
+			cached[i].width = rows[i].width;
+			cached[i].minx = rows[i].minx;
+			cached[i].maxx = rows[i].maxx;
+		}
+	}
+
+	return nrows;
+}
+
+static float nvg__textBounds(NVGcontext* ctx, float x, float y, const char* string, const char* end, float* bounds)
 {
 	NVGstate* state = nvg__getState(ctx);
-	float scale = nvg__getFontScale(state) * ctx->devicePxRatio;
+	float scale = nvg__getTextScale(ctx, state);
 	float invscale = 1.0f / scale;
 	float width;
 
@@ -2820,11 +4702,39 @@ float nvgTextBounds(NVGcontext* ctx, float x, float y, const char* string, const
 	return width * invscale;
 }
 
+float nvgTextBounds(NVGcontext* ctx, float x, float y, const char* string, const char* end, float* bounds)
+{
+	NVGtextCacheKey key;
+	NVGtextCacheEntry* entry;
+	float b[4], width;
+
+	if (end == NULL)
+		end = string + strlen(string);
+
+	entry = nvg__findTextCache(ctx, &key, NVG_TEXT_CACHE_BOUNDS, x, y, 0, string, end);
+	if (entry != NULL && nvg__textCacheHit(ctx, entry, &key, string, 0)) {
+		if (bounds != NULL)
+			memcpy(bounds, entry->bounds, sizeof(entry->bounds));
+		return entry->width;
+	}
+
+	width = nvg__textBounds(ctx, x, y, string, end, b);
+	if (bounds != NULL)
+		memcpy(bounds, b, sizeof(b));
+
+	if (entry != NULL && nvg__storeTextCache(ctx, entry, &key, string, 0, 1, 0)) {
+		entry->width = width;
+		memcpy(entry->bounds, b, sizeof(b));
+	}
+
+	return width;
+}
+
 void nvgTextBoxBounds(NVGcontext* ctx, float x, float y, float breakRowWidth, const char* string, const char* end, float* bounds)
 {
 	NVGstate* state = nvg__getState(ctx);
 	NVGtextRow rows[2];
-	float scale = nvg__getFontScale(state) * ctx->devicePxRatio;
+	float scale = nvg__getTextScale(ctx, state);
 	float invscale = 1.0f / scale;
 	int nrows = 0, i;
 	int oldAlign = state->textAlign;
@@ -2841,6 +4751,7 @@ void nvgTextBoxBounds(NVGcontext* ctx, float x, float y, float breakRowWidth, co
 
 	nvgTextMetrics(ctx, NULL, NULL, &lineh);
 
+	nvg__editState(ctx, 1 << NVG_STATE_TEXT);
 	state->textAlign = NVG_ALIGN_LEFT | valign;
 
 	minx = maxx = x;
@@ -2892,7 +4803,7 @@ void nvgTextBoxBounds(NVGcontext* ctx, float x, float y, float breakRowWidth, co
 void nvgTextMetrics(NVGcontext* ctx, float* ascender, float* descender, float* lineh)
 {
 	NVGstate* state = nvg__getState(ctx);
-	float scale = nvg__getFontScale(state) * ctx->devicePxRatio;
+	float scale = nvg__getTextScale(ctx, state);
 	float invscale = 1.0f / scale;
 
 	if (state->fontId == FONS_INVALID) return;
@@ -65,6 +65,15 @@ enum NVGsolidity {
 	NVG_HOLE = 2,			// CW
 };
 
+// Path commands, see nvgAppendPath().
+enum NVGcommands {
+	NVG_MOVETO = 0,			// x, y
+	NVG_LINETO = 1,			// x, y
+	NVG_BEZIERTO = 2,		// c1x, c1y, c2x, c2y, x, y
+	NVG_CLOSE = 3,
+	NVG_WINDING = 4,		// dir, see NVGwinding and NVGsolidity
+};
+
 enum NVGlineCap {
 	NVG_BUTT,
 	NVG_ROUND,
@@ -162,6 +171,50 @@ void nvgCancelFrame(NVGcontext* ctx);
 // Ends drawing flushing remaining render state.
 void nvgEndFrame(NVGcontext* ctx);
 
+// Defers tessellation of fills and strokes when enabled. They are recorded with their
+// render state and tessellated in parallel on worker threads in batches of a few dozen,
+// when the frame ends, or when text or image updates need the back-end, then submitted
+// in drawing order. A path filled and stroked is flattened once, as it is right away.
+// The allocator of the context must be thread safe while this is enabled.
+void nvgDeferTessellation(NVGcontext* ctx, int defer);
+
+//
+// Display lists
+//
+// Display lists keep the tessellated output of drawing calls so that unchanged content
+// can be drawn again without building and tessellating its paths every frame.
+//
+//		nvgBeginRecord(vg, list);
+//		... draw as usual ...
+//		nvgEndRecord(vg);
+//		...
+//		if (!nvgReplay(vg, list)) { ... record again ... }
+//
+// Replay applies the current transform relative to the one the list was recorded with,
+// the current scissor and global alpha. Anti-aliasing fringes keep the width they were
+// recorded with, so lists replayed at a different scale should be recorded again.
+
+typedef struct NVGdisplayList NVGdisplayList;
+
+// Creates an empty display list.
+NVGdisplayList* nvgCreateDisplayList(NVGcontext* ctx);
+
+// Deletes display list.
+void nvgDeleteDisplayList(NVGcontext* ctx, NVGdisplayList* list);
+
+// Clears the display list and starts recording into it, must be called between
+// nvgBeginFrame() and nvgEndFrame(). Calls are not drawn while recording.
+// Recordings can be nested, calls of the inner list go to the outer one when it is replayed.
+void nvgBeginRecord(NVGcontext* ctx, NVGdisplayList* list);
+
+// Stops recording into the current list, resuming the list that was recorded before it.
+void nvgEndRecord(NVGcontext* ctx);
+
+// Draws the recorded calls of the display list.
+// Returns 0 when the list is stale and has to be recorded again, for example after
+// glyphs it uses have moved in the font atlas.
+int nvgReplay(NVGcontext* ctx, NVGdisplayList* list);
+
 //
 // Composite operation
 //
@@ -274,6 +327,9 @@ void nvgLineJoin(NVGcontext* ctx, int join);
 // Already transparent paths will get proportionally more transparent as well.
 void nvgGlobalAlpha(NVGcontext* ctx, float alpha);
 
+// Returns the current global alpha.
+float nvgCurrentGlobalAlpha(NVGcontext* ctx);
+
 //
 // Transforms
 //
@@ -478,6 +534,11 @@ void nvgClosePath(NVGcontext* ctx);
 // Sets the current sub-path winding, see NVGwinding and NVGsolidity.
 void nvgPathWinding(NVGcontext* ctx, int dir);
 
+// Appends path commands in bulk, each command (see NVGcommands) followed by its values.
+// Equivalent to the matching nvgMoveTo(), nvgLineTo(), nvgBezierTo(), nvgClosePath() and
+// nvgPathWinding() calls, but reserves space and transforms the points in a single pass.
+void nvgAppendPath(NVGcontext* ctx, const float* commands, int ncommands);
+
 // Creates new circle arc shaped sub-path. The arc center is at cx,cy, the arc radius is r,
 // and the arc is drawn from angle a0 to a1, and swept in direction dir (NVG_CCW, or NVG_CW).
 // Angles are specified in radians.
@@ -504,6 +565,11 @@ void nvgFill(NVGcontext* ctx);
 // Fills the current path with current stroke style.
 void nvgStroke(NVGcontext* ctx);
 
+// Returns how many fills and strokes were skipped since nvgBeginFrame() because they were
+// entirely outside of the view and scissor, and how many were drawn. Nothing is skipped
+// while recording a display list.
+void nvgCullStats(NVGcontext* ctx, int* culled, int* drawn);
+
 
 //
 // Text
@@ -542,6 +608,10 @@ void nvgStroke(NVGcontext* ctx);
 // Returns handle to the font.
 int nvgCreateFont(NVGcontext* ctx, const char* name, const char* filename);
 
+// Creates font by memory mapping the specified file read-only, so that only the parts
+// of the file used for drawing are paged in. Returns handle to the font.
+int nvgCreateFontMapped(NVGcontext* ctx, const char* name, const char* filename);
+
 // Creates font by loading it from the specified memory chunk.
 // Returns handle to the font.
 int nvgCreateFontMem(NVGcontext* ctx, const char* name, unsigned char* data, int ndata, int freeData);
@@ -570,6 +640,11 @@ void nvgTextLineHeight(NVGcontext* ctx, float lineHeight);
 // Sets the text align of current text style, see NVGalign for options.
 void nvgTextAlign(NVGcontext* ctx, int align);
 
+// Sets the step in pixels that the size of rasterized glyphs is rounded to, 0 (default) disables rounding.
+// Text is scaled by the remaining difference when drawn, so animated or fractionally scaled text
+// reuses a bounded set of glyph bitmaps. A step of 0.25 keeps the size error under 1/8 pixel.
+void nvgFontSizeQuantization(NVGcontext* ctx, float step);
+
 // Sets the font face based on specified id of current text style.
 void nvgFontFaceId(NVGcontext* ctx, int font);
 
@@ -608,6 +683,31 @@ void nvgTextMetrics(NVGcontext* ctx, float* ascender, float* descender, float* l
 // Words longer than the max width are slit at nearest character (i.e. no hyphenation).
 int nvgTextBreakLines(NVGcontext* ctx, const char* string, const char* end, float breakRowWidth, NVGtextRow* rows, int maxRows);
 
+// Returns how many text measurements were answered from the measurement cache, and how many were computed.
+// Bounds, glyph positions and line breaks of short strings are cached per font, size, spacing, alignment and position.
+void nvgTextCacheStats(NVGcontext* ctx, int* hits, int* misses);
+
+// Returns the portion of the glyph atlas taken by recently drawn glyphs, and the portion
+// of its allocated space which is wasted by gaps and stale glyphs. The atlas is repacked
+// into a new, possibly smaller, texture when it gets too fragmented.
+void nvgTextAtlasStats(NVGcontext* ctx, float* occupancy, float* fragmentation);
+
+// Adds the glyphs of the specified string to the glyph atlas using the current font face, size,
+// blur and transform, without drawing anything. Useful to avoid rasterizing text on first frames.
+// Glyphs are rasterized as a frame begun with the specified device pixel ratio would draw them,
+// so the call does not depend on the ratio of the frame before, and may be made outside of frames.
+// Returns the number of glyphs which could not be added.
+int nvgTextPrewarm(NVGcontext* ctx, float devicePixelRatio, const char* string, const char* end);
+
+// Saves the glyph atlas to a cache file.
+int nvgSaveTextAtlas(NVGcontext* ctx, const char* path);
+
+// Replaces the glyph atlas with one saved by nvgSaveTextAtlas(), so that glyphs do not need to be
+// rasterized again. Glyphs of fonts created later are restored when the font is created, glyphs of
+// fonts whose data changed are not restored. Should be called before any text is drawn in a frame.
+// Returns the number of glyphs restored for the fonts created so far.
+int nvgLoadTextAtlas(NVGcontext* ctx, const char* path);
+
 //
 // Internal Render API
 //
@@ -643,7 +743,9 @@ typedef struct NVGpath NVGpath;
 
 struct NVGparams {
 	void* userPtr;
+	bx::AllocatorI* allocator; // Allocator for all memory of the context, NULL for the default heap allocator.
 	int edgeAntiAlias;
+	int maxTriangulatedFill; // Single path concave fills with at most this many vertices are given a half fringe like convex ones, for back-ends drawing them as triangles.
 	int (*renderCreate)(void* uptr);
 	int (*renderCreateTexture)(void* uptr, int type, int w, int h, int imageFlags, const unsigned char* data);
 	int (*renderDeleteTexture)(void* uptr, int image);
@@ -22,6 +22,12 @@
 //
 #define NVG_ANTIALIAS 1
 
+// Single path concave fills with at most this many vertices are triangulated
+// on the CPU and drawn as plain triangles, instead of with the stencil passes.
+#ifndef NVG_MAX_TRIANGULATED_FILL
+#	define NVG_MAX_TRIANGULATED_FILL 32
+#endif
+
 #include <stdlib.h>
 #include <math.h>
 #include "nanovg.h"
@@ -824,6 +830,8 @@ namespace
 	}
 
 	static int glnvg__maxi(int a, int b) { return a > b ? a : b; }
+	static float glnvg__minf(float a, float b) { return a < b ? a : b; }
+	static float glnvg__maxf(float a, float b) { return a > b ? a : b; }
 
 	static struct GLNVGcall* glnvg__allocCall(struct GLNVGcontext* gl)
 	{
@@ -892,6 +900,151 @@ namespace
 		vtx->v = v;
 	}
 
+	static float glnvg__orient(const struct NVGvertex* a, const struct NVGvertex* b, const struct NVGvertex* c)
+	{
+		return (b->x - a->x) * (c->y - a->y) - (c->x - a->x) * (b->y - a->y);
+	}
+
+	static int glnvg__segmentsIntersect(const struct NVGvertex* a, const struct NVGvertex* b, const struct NVGvertex* c, const struct NVGvertex* d)
+	{
+		float d1 = glnvg__orient(a, b, c);
+		float d2 = glnvg__orient(a, b, d);
+		float d3 = glnvg__orient(c, d, a);
+		float d4 = glnvg__orient(c, d, b);
+		if ((d1 > 0.0f && d2 > 0.0f) || (d1 < 0.0f && d2 < 0.0f)) return 0;
+		if ((d3 > 0.0f && d4 > 0.0f) || (d3 < 0.0f && d4 < 0.0f)) return 0;
+		// Collinear segments only meet when their extents overlap.
+		return glnvg__minf(a->x, b->x) <= glnvg__maxf(c->x, d->x) && glnvg__minf(c->x, d->x) <= glnvg__maxf(a->x, b->x)
+			&& glnvg__minf(a->y, b->y) <= glnvg__maxf(c->y, d->y) && glnvg__minf(c->y, d->y) <= glnvg__maxf(a->y, b->y);
+	}
+
+	// Triangulates a fill outline by ear clipping, writing the vertex indices
+	// of the triangles to 'tris'. Returns the number of triangles, or -1 when
+	// the outline crosses itself, so that the fill rule matters and the fill
+	// has to be stenciled.
+	static int glnvg__triangulate(const struct NVGvertex* pts, int npts, int* tris)
+	{
+		int prev[NVG_MAX_TRIANGULATED_FILL], next[NVG_MAX_TRIANGULATED_FILL];
+		int i, j, n, ntris = 0, skipped = 0;
+		float area = 0.0f, sign;
+
+		if (npts < 3 || npts > NVG_MAX_TRIANGULATED_FILL) return -1;
+
+		for (i = 0, j = npts-1; i < npts; j = i++)
+		{
+			area += pts[j].x * pts[i].y - pts[i].x * pts[j].y;
+		}
+		if (area == 0.0f) return -1;
+		sign = area > 0.0f ? 1.0f : -1.0f;
+
+		for (i = 0; i < npts; i++)
+		{
+			for (j = i+2; j < npts; j++)
+			{
+				if (i == 0 && j == npts-1) continue;
+				if (glnvg__segmentsIntersect(&pts[i], &pts[i+1], &pts[j], &pts[(j+1) % npts]) ) return -1;
+			}
+		}
+
+		for (i = 0; i < npts; i++)
+		{
+			prev[i] = i == 0 ? npts-1 : i-1;
+			next[i] = i == npts-1 ? 0 : i+1;
+		}
+
+		i = 0;
+		n = npts;
+		while (n > 3)
+		{
+			int a = prev[i], c = next[i], ear = 1;
+			float cross = glnvg__orient(&pts[a], &pts[i], &pts[c]) * sign;
+
+			if (cross > 0.0f)
+			{
+				// No other vertex may lie in or on the ear.
+				for (j = next[c]; j != a; j = next[j])
+				{
+					if (glnvg__orient(&pts[a], &pts[i], &pts[j]) * sign >= 0.0f
+					&&  glnvg__orient(&pts[i], &pts[c], &pts[j]) * sign >= 0.0f
+					&&  glnvg__orient(&pts[c], &pts[a], &pts[j]) * sign >= 0.0f)
+					{
+						ear = 0;
+						break;
+					}
+				}
+
+				if (ear)
+				{
+					tris[ntris*3+0] = a;
+					tris[ntris*3+1] = i;
+					tris[ntris*3+2] = c;
+					ntris++;
+				}
+			}
+			else if (cross < 0.0f)
+			{
+				ear = 0;
+			}
+			// Collinear vertices are dropped without a triangle.
+
+			if (ear)
+			{
+				next[a] = c;
+				prev[c] = a;
+				n--;
+				skipped = 0;
+				i = a;
+			}
+			else
+			{
+				// A full turn without an ear only happens with rounding trouble.
+				if (++skipped > n) return -1;
+				i = c;
+			}
+		}
+
+		tris[ntris*3+0] = prev[i];
+		tris[ntris*3+1] = i;
+		tris[ntris*3+2] = next[i];
+		ntris++;
+
+		return ntris;
+	}
+
+	// Draws a small concave fill as a triangle list of its triangulated
+	// outline and its fringe strip. Returns 0 when it has to be stenciled.
+	static int glnvg__triangleFill(struct GLNVGcontext* gl, struct GLNVGcall* call, const struct NVGpath* path)
+	{
+		int tris[(NVG_MAX_TRIANGULATED_FILL-2)*3];
+		struct NVGvertex* dst;
+		int i, ntris, nstrip;
+
+		ntris = glnvg__triangulate(path->fill, path->nfill, tris);
+		if (ntris < 0) return 0;
+
+		nstrip = path->nstroke > 2 ? path->nstroke-2 : 0;
+
+		call->vertexCount = (ntris + nstrip) * 3;
+		call->vertexOffset = glnvg__allocVerts(gl, call->vertexCount);
+		if (call->vertexOffset == -1) return 0;
+		call->type = GLNVG_TRIANGLES;
+		dst = &gl->verts[call->vertexOffset];
+
+		for (i = 0; i < ntris*3; i++)
+		{
+			*dst++ = path->fill[tris[i]];
+		}
+
+		for (i = 0; i < nstrip; i++)
+		{
+			*dst++ = path->stroke[i];
+			*dst++ = path->stroke[i+1];
+			*dst++ = path->stroke[i+2];
+		}
+
+		return 1;
+	}
+
 	static void nvgRenderFill(
 		  void* _userPtr
 		, NVGpaint* paint
@@ -911,11 +1064,22 @@ namespace
 		int i, maxverts, offset;
 
 		call->type = GLNVG_FILL;
-		call->pathOffset = glnvg__allocPaths(gl, npaths);
-		call->pathCount = npaths;
 		call->image = paint->image;
 		call->blendFunc = glnvg__blendCompositeOperation(compositeOperation);
 
+		// Small concave fills are cheaper to triangulate than to stencil,
+		// and go out in a single draw without touching the stencil state.
+		if (npaths == 1 && !paths[0].convex && paths[0].nfill <= NVG_MAX_TRIANGULATED_FILL
+		&&  glnvg__triangleFill(gl, call, &paths[0]) )
+		{
+			call->uniformOffset = glnvg__allocFragUniforms(gl, 1);
+			glnvg__convertPaint(gl, nvg__fragUniformPtr(gl, call->uniformOffset), paint, scissor, fringe, fringe);
+			return;
+		}
+
+		call->pathOffset = glnvg__allocPaths(gl, npaths);
+		call->pathCount = npaths;
+
 		if (npaths == 1 && paths[0].convex)
 		{
 			call->type = GLNVG_CONVEXFILL;
@@ -1123,7 +1287,9 @@ NVGcontext* nvgCreate(int32_t _edgeaa, bgfx::ViewId _viewId, bx::AllocatorI* _al
 	params.renderTriangles      = nvgRenderTriangles;
 	params.renderDelete         = nvgRenderDelete;
 	params.userPtr              = gl;
+	params.allocator            = _allocator;
 	params.edgeAntiAlias        = _edgeaa;
+	params.maxTriangulatedFill  = NVG_MAX_TRIANGULATED_FILL;
 
 	gl->allocator     = _allocator;
 	gl->edgeAntiAlias = _edgeaa;
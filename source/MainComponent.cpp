@@ -15,6 +15,10 @@ MainComponent::MainComponent()
     addAndMakeVisible(button);
 
     setBackgroundColour (Colour(0x1F, 0x1F, 0x1F));
+    setGlyphCacheFile (File::getSpecialLocation (File::userApplicationDataDirectory)
+                           .getChildFile (ProjectInfo::projectName)
+                           .getChildFile ("glyphs.cache"));
+    prewarmGlyphs ({NanovgGraphicsContext::defaultTypefaceName}, {15.0f});
     enableRenderStats();
     startPeriodicRepaint();
 }
@@ -13,6 +13,11 @@ NanovgComponent::~NanovgComponent()
 {
     if (nvg != nullptr)
     {
+        if (glyphCacheFile != File()
+            && ! (glyphCacheFile.getParentDirectory().createDirectory()
+                  && nvgSaveTextAtlas (nvg, glyphCacheFile.getFullPathName().toRawUTF8())))
+            DBG ("Unable to save glyph cache to " << glyphCacheFile.getFullPathName());
+
         nvgGraphicsContext->removeCachedImages();
         nvgDelete (nvg);
     }
@@ -26,17 +31,85 @@ void NanovgComponent::renderFrame()
     {
         nvg = nvgCreate (1, 0);
 
+        // Animated and fractionally scaled text then reuses a bounded set of glyph sizes.
+        nvgFontSizeQuantization (nvg, 0.25f);
+
+        if (deferTessellation)
+            nvgDeferTessellation (nvg, 1);
+
         const float width {getWidth() * scale};
         const float height {getHeight() * scale};
 
         nvgGraphicsContext.reset (new NanovgGraphicsContext (nvg, (int)width, (int)height));
+
+        if (glyphCacheFile.existsAsFile())
+        {
+            // Glyphs of fonts loaded later on are restored as they are loaded.
+            const int restored {nvgLoadTextAtlas (nvg, glyphCacheFile.getFullPathName().toRawUTF8())};
+            DBG ("Restored " << restored << " glyphs from " << glyphCacheFile.getFullPathName());
+        }
     }
 
+    // Rasterize outside of the frame, so that the frame only draws.
+    prewarmPendingGlyphs (scale);
+
+    const auto frameStart {Time::getMillisecondCounterHiRes()};
+
     nvgBeginFrame (nvg, getWidth(), getHeight(), scale);
 
     renderNanovgFrame (nvg);
 
     nvgEndFrame (nvg);
+
+    if (firstFrame)
+    {
+        // Text rasterization dominates the first frame, compare with and without prewarming.
+        DBG ("First frame took " << (Time::getMillisecondCounterHiRes() - frameStart) << " ms");
+        firstFrame = false;
+    }
+}
+
+void NanovgComponent::prewarmPendingGlyphs (float scale)
+{
+    if (pendingPrewarms.empty())
+        return;
+
+    const auto prewarmStart {Time::getMillisecondCounterHiRes()};
+    int missing {0};
+
+    // Start from the state a frame starts with, not the one the last frame left behind.
+    nvgSave (nvg);
+    nvgReset (nvg);
+
+    for (const auto& p : pendingPrewarms)
+        missing += nvgGraphicsContext->prewarmGlyphs (p.typefaceNames, p.sizes, p.characters, scale);
+
+    nvgRestore (nvg);
+
+    pendingPrewarms.clear();
+
+    DBG ("Glyph prewarm took " << (Time::getMillisecondCounterHiRes() - prewarmStart) << " ms"
+         << (missing > 0 ? ", " + String (missing) + " glyphs did not fit" : String()));
+}
+
+void NanovgComponent::prewarmGlyphs (const StringArray& typefaceNames,
+                                     const Array<float>& sizes,
+                                     const String& characters)
+{
+    pendingPrewarms.push_back ({typefaceNames, sizes, characters});
+}
+
+void NanovgComponent::setGlyphCacheFile (const File& file)
+{
+    glyphCacheFile = file;
+}
+
+void NanovgComponent::setDeferredTessellation (bool shouldDefer)
+{
+    deferTessellation = shouldDefer;
+
+    if (nvg != nullptr)
+        nvgDeferTessellation (nvg, shouldDefer ? 1 : 0);
 }
 
 void NanovgComponent::resized()
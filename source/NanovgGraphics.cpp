@@ -47,6 +47,226 @@ static const char* getResourceByFileName(const String& fileName, int& size)
 
 //==============================================================================
 
+/** Maps glyph numbers of a font back to characters.
+
+    The map is built the first time a glyph is looked up, so fonts cost
+    nothing until used, by walking the font's character map subtable once
+    rather than looking up every character.
+
+    Font files may be registered from anywhere, so every offset read from
+    the font is checked against its size. Fonts whose tables do not fit
+    are left unmapped.
+*/
+class NanovgGraphicsContext::GlyphToCharMap
+{
+public:
+    GlyphToCharMap (const void* fontData, size_t fontDataSize, std::unique_ptr<MemoryMappedFile> file)
+        : mappedFile {std::move (file)},
+          dataSize {fontDataSize}
+    {
+        const auto* data = (const unsigned char*) fontData;
+
+        // stb_truetype follows the table directory without checking it.
+        if (dataSize < 16)
+            return;
+
+        const auto offset = stbtt_GetFontOffsetForIndex (data, 0);
+
+        if (tablesWithin (data, offset) && stbtt_InitFont (&info, data, offset) != 0)
+            chars.resize ((size_t) info.numGlyphs, 0);
+    }
+
+    /** Returns the character drawn by the glyph, or 0 when there is none. */
+    juce_wchar getChar (int glyph)
+    {
+        if (glyph <= 0 || glyph >= (int) chars.size())
+            return 0;
+
+        if (! mapped)
+            mapChars();
+
+        return chars[(size_t) glyph];
+    }
+
+private:
+    // Only printable characters are mapped.
+    constexpr static juce_wchar firstChar {32};
+    constexpr static uint32 lastChar {0x10ffff};
+
+    std::unique_ptr<MemoryMappedFile> mappedFile;
+    size_t dataSize {};
+    stbtt_fontinfo info {};
+    std::vector<juce_wchar> chars {}; // Indexed by glyph number, 0 when not mapped.
+    bool mapped {false};
+
+    static uint32 readU16 (const unsigned char* p) { return (uint32) ((p[0] << 8) | p[1]); }
+    static uint32 readU32 (const unsigned char* p) { return (readU16 (p) << 16) | readU16 (p + 2); }
+
+    /** True when the table directory and every table it lists lie within the font data. */
+    bool tablesWithin (const unsigned char* data, int offset) const
+    {
+        if (offset < 0 || (uint64) offset + 12 > dataSize)
+            return false;
+
+        const auto* directory = data + offset;
+        const auto numTables = readU16 (directory + 4);
+
+        if ((uint64) offset + 12 + (uint64) numTables * 16 > dataSize)
+            return false;
+
+        for (uint32 i = 0; i < numTables; ++i)
+        {
+            const auto* record = directory + 12 + i * 16;
+
+            if ((uint64) readU32 (record + 8) + readU32 (record + 12) > dataSize)
+                return false;
+        }
+
+        return true;
+    }
+
+    /** True when 'size' bytes from 'p' lie within the font data. */
+    bool within (const unsigned char* p, uint64 size) const
+    {
+        return p >= info.data && (uint64) (p - info.data) + size <= dataSize;
+    }
+
+    /** Keeps the lowest character drawing a glyph, as characters are met in increasing order. */
+    void setChar (juce_wchar c, uint32 glyph)
+    {
+        if (c >= firstChar && glyph > 0 && glyph < (uint32) chars.size() && chars[glyph] == 0)
+            chars[glyph] = c;
+    }
+
+    void mapChars()
+    {
+        mapped = true;
+
+        // The subtable stb_truetype picked for Unicode characters, at an offset read from the font.
+        if (info.index_map < 0 || (uint64) info.index_map + 16 > dataSize)
+            return;
+
+        const auto* cmap = info.data + info.index_map;
+
+        bool consistent {true};
+
+        switch (readU16 (cmap))
+        {
+            case 4:  consistent = mapSegments (cmap); break;
+            case 12: consistent = mapGroups (cmap); break;
+            default: mapByLookup (cmap); break;
+        }
+
+        // Partly mapped tables are not trusted.
+        if (! consistent)
+            std::fill (chars.begin(), chars.end(), 0);
+    }
+
+    /** Format 4: segments of the basic multilingual plane, in increasing order. */
+    bool mapSegments (const unsigned char* cmap)
+    {
+        const auto segCountX2 = readU16 (cmap + 6);
+        const auto* endCodes = cmap + 14;
+        const auto* startCodes = endCodes + segCountX2 + 2;
+        const auto* idDeltas = startCodes + segCountX2;
+        const auto* idRangeOffsets = idDeltas + segCountX2;
+
+        if ((segCountX2 & 1) != 0 || ! within (endCodes, (uint64) segCountX2 * 4 + 2))
+            return false;
+
+        uint32 nextStart {0};
+
+        for (uint32 i = 0; i < segCountX2; i += 2)
+        {
+            const auto start = readU16 (startCodes + i);
+            const auto end = readU16 (endCodes + i);
+            const auto delta = readU16 (idDeltas + i);
+            const auto rangeOffset = readU16 (idRangeOffsets + i);
+
+            if (start == 0xffff)
+                break;
+
+            if (start < nextStart || end < start)
+                return false;
+
+            nextStart = end + 1;
+
+            if (rangeOffset != 0 && ! within (idRangeOffsets + i + rangeOffset, (uint64) (end - start + 1) * 2))
+                return false;
+
+            for (auto c = start; c <= end; ++c)
+            {
+                if (rangeOffset == 0)
+                {
+                    setChar ((juce_wchar) c, (c + delta) & 0xffff);
+                }
+                else
+                {
+                    const auto glyph = readU16 (idRangeOffsets + i + rangeOffset + (c - start) * 2);
+
+                    if (glyph != 0)
+                        setChar ((juce_wchar) c, (glyph + delta) & 0xffff);
+                }
+            }
+        }
+
+        return true;
+    }
+
+    /** Format 12: groups of consecutive characters and glyphs in increasing order,
+        including characters beyond the BMP.
+    */
+    bool mapGroups (const unsigned char* cmap)
+    {
+        const auto numGroups = readU32 (cmap + 12);
+        const auto numGlyphs = (uint64) chars.size();
+
+        if (! within (cmap + 16, (uint64) numGroups * 12))
+            return false;
+
+        uint64 nextStart {0};
+
+        for (uint32 i = 0; i < numGroups; ++i)
+        {
+            const auto* group = cmap + 16 + (uint64) i * 12;
+            const auto start = readU32 (group);
+            const auto end = readU32 (group + 4);
+            const auto startGlyph = readU32 (group + 8);
+
+            // Sorted groups within Unicode bound the walk to one pass over the characters.
+            if (start < nextStart || end < start || end > lastChar)
+                return false;
+
+            nextStart = (uint64) end + 1;
+
+            // Groups may span far more characters than the font has glyphs.
+            for (uint64 n = 0; start + n <= end && startGlyph + n < numGlyphs; ++n)
+                setChar ((juce_wchar) (start + n), (uint32) (startGlyph + n));
+        }
+
+        return true;
+    }
+
+    /** Other formats are rare and small, look the basic multilingual plane up
+        with stb_truetype, which reads them unchecked, if the tables fit.
+    */
+    void mapByLookup (const unsigned char* cmap)
+    {
+        switch (readU16 (cmap))
+        {
+            case 0:  if (! within (cmap + 6, 256)) return; break;
+            case 6:  if (! within (cmap + 10, (uint64) readU16 (cmap + 8) * 2)) return; break;
+            case 13: if (! within (cmap + 16, (uint64) readU32 (cmap + 12) * 12)) return; break;
+            default: return; // Not supported by stb_truetype either.
+        }
+
+        for (juce_wchar c = firstChar; c <= 0xffff; ++c)
+            setChar (c, (uint32) stbtt_FindGlyphIndex (&info, (int) c));
+    }
+};
+
+//==============================================================================
+
 const String NanovgGraphicsContext::defaultTypefaceName = "Verdana-Regular";
 
 const int NanovgGraphicsContext::imageCacheSize = 256;
@@ -155,7 +375,7 @@ void NanovgGraphicsContext::restoreState()
 void NanovgGraphicsContext::beginTransparencyLayer (float op)
 {
     saveState();
-    nvgGlobalAlpha (nvg, op);
+    nvgGlobalAlpha (nvg, nvgCurrentGlobalAlpha (nvg) * op);
 }
 
 void NanovgGraphicsContext::endTransparencyLayer()
@@ -202,12 +422,21 @@ void NanovgGraphicsContext::fillRectList (const RectangleList<float>& rects)
 
 void NanovgGraphicsContext::fillPath (const Path& path, const AffineTransform& transform)
 {
-    Path p (path);
-    p.applyTransform (transform);
+    // The path is transformed while converting it, rather than copying it first.
+    pathCommands.clear();
 
-    nvgBeginPath (nvg);
+    float lastX {}, lastY {};
+
+    const auto addPoint = [&] (float x, float y)
+    {
+        transform.transformPoint (x, y);
+        pathCommands.push_back (x);
+        pathCommands.push_back (y);
+        lastX = x;
+        lastY = y;
+    };
 
-    Path::Iterator i (p);
+    Path::Iterator i (path);
 
     // Flag is used to flip winding when drawing shapes with holes.
     bool solid = true;
@@ -217,20 +446,36 @@ void NanovgGraphicsContext::fillPath (const Path& path, const AffineTransform& t
         switch (i.elementType)
         {
         case Path::Iterator::startNewSubPath:
-            nvgMoveTo (nvg, i.x1, i.y1);
+            pathCommands.push_back (NVG_MOVETO);
+            addPoint (i.x1, i.y1);
             break;
         case Path::Iterator::lineTo:
-            nvgLineTo (nvg, i.x1, i.y1);
+            pathCommands.push_back (NVG_LINETO);
+            addPoint (i.x1, i.y1);
             break;
         case Path::Iterator::quadraticTo:
-            nvgQuadTo (nvg, i.x1, i.y1, i.x2, i.y2);
+        {
+            // Same conversion to a cubic as nvgQuadTo().
+            float cx {i.x1}, cy {i.y1}, x {i.x2}, y {i.y2};
+            transform.transformPoints (cx, cy, x, y);
+
+            pathCommands.insert (pathCommands.end(), { (float) NVG_BEZIERTO,
+                                                      lastX + 2.0f / 3.0f * (cx - lastX), lastY + 2.0f / 3.0f * (cy - lastY),
+                                                      x + 2.0f / 3.0f * (cx - x), y + 2.0f / 3.0f * (cy - y),
+                                                      x, y });
+            lastX = x;
+            lastY = y;
             break;
+        }
         case Path::Iterator::cubicTo:
-            nvgBezierTo (nvg, i.x1, i.y1, i.x2, i.y2, i.x3, i.y3);
+            pathCommands.push_back (NVG_BEZIERTO);
+            addPoint (i.x1, i.y1);
+            addPoint (i.x2, i.y2);
+            addPoint (i.x3, i.y3);
             break;
         case Path::Iterator::closePath:
-            nvgClosePath (nvg);
-            nvgPathWinding (nvg, solid ? NVG_SOLID : NVG_HOLE);
+            pathCommands.insert (pathCommands.end(), { (float) NVG_CLOSE,
+                                                      (float) NVG_WINDING, (float) (solid ? NVG_SOLID : NVG_HOLE) });
             solid = ! solid;
             break;
         default:
@@ -238,6 +483,9 @@ void NanovgGraphicsContext::fillPath (const Path& path, const AffineTransform& t
         }
     }
 
+    nvgBeginPath (nvg);
+    nvgAppendPath (nvg, pathCommands.data(), (int) pathCommands.size());
+
     applyFillType();
     nvgFill (nvg);
 }
@@ -298,14 +546,17 @@ void NanovgGraphicsContext::drawGlyph (int glyphNumber, const AffineTransform& t
     if (currentGlyphToCharMap == nullptr)
         return;
 
-    char txt[2] = {'?', 0};
+    auto c = currentGlyphToCharMap->getChar (glyphNumber);
 
-    if (currentGlyphToCharMap->find (glyphNumber) != currentGlyphToCharMap->end())
-        txt[0] = (char)currentGlyphToCharMap->at (glyphNumber);
+    if (c == 0)
+        c = '?';
 
-    nvgFillColor (nvg, nvgColour (fillType.colour));
-    nvgText (nvg, t.getTranslationX(), t.getTranslationY(), txt, &txt[1]);
+    char txt[8] {};
+    CharPointer_UTF8 end (txt);
+    end.write (c);
 
+    nvgFillColor (nvg, nvgColour (fillType.colour));
+    nvgText (nvg, t.getTranslationX(), t.getTranslationY(), txt, end.getAddress());
 }
 
 bool NanovgGraphicsContext::drawTextLayout (const AttributedString& str, const Rectangle<float>& rect)
@@ -313,8 +564,11 @@ bool NanovgGraphicsContext::drawTextLayout (const AttributedString& str, const R
     nvgSave (nvg);
     nvgIntersectScissor (nvg, rect.getX(), rect.getY(), rect.getWidth(), rect.getHeight());
 
-    const std::string text = str.getText().toStdString();
-    const char* textPtr = text.c_str();
+    // Text is handed to nanovg straight from the string storage.
+    static_assert (std::is_same_v<String::CharPointerType, CharPointer_UTF8>,
+                   "nanovg expects UTF-8 text");
+
+    const auto textStart = str.getText().getCharPointer();
 
     // NOTE:
     // This will not perform the correct rendering when JUCE's assumed font
@@ -333,18 +587,32 @@ bool NanovgGraphicsContext::drawTextLayout (const AttributedString& str, const R
 
     nvgTextAlign (nvg, NVG_ALIGN_TOP);
 
+    // Attribute ranges are in characters, while nanovg takes UTF-8 bytes,
+    // so walk the text once along the (normally consecutive) ranges.
+    auto pos = textStart;
+    int posIndex = 0;
+
     for (int i = 0; i < str.getNumAttributes(); ++i)
     {
-        const auto attr = str.getAttribute (i);
+        const auto& attr = str.getAttribute (i);
         setFont (attr.font);
         nvgFillColor (nvg, nvgColour (attr.colour));
 
-        const char* begin = &textPtr[attr.range.getStart()];
-        const char* end = &textPtr[attr.range.getEnd()];
+        if (attr.range.getStart() < posIndex)
+        {
+            pos = textStart;
+            posIndex = 0;
+        }
+
+        auto begin = pos + (attr.range.getStart() - posIndex);
+        auto end = begin + attr.range.getLength();
 
         // We assume that ranges are sorted by x so that we can move
         // to the next glyph position efficiently.
-        x = nvgText (nvg, x, y, begin, end);
+        x = nvgText (nvg, x, y, begin.getAddress(), end.getAddress());
+
+        pos = end;
+        posIndex = attr.range.getEnd();
     }
 
     nvgRestore (nvg);
@@ -363,6 +631,40 @@ void NanovgGraphicsContext::removeCachedImages()
         nvgDeleteImage (nvg, it->second.id);
 
     images.clear();
+    ++imageCacheGeneration;
+}
+
+int NanovgGraphicsContext::prewarmGlyphs (const StringArray& typefaceNames,
+                                          const Array<float>& sizes,
+                                          const String& characters,
+                                          float devicePixelRatio)
+{
+    const auto& str {characters.isEmpty() ? allPrintableAsciiCharacters : characters};
+    auto* glyphToCharMap {currentGlyphToCharMap};
+    int missing {0};
+
+    nvgSave (nvg);
+
+    for (const auto& name : typefaceNames)
+    {
+        if (! loadFontFromResources (name))
+            continue;
+
+        nvgFontFace (nvg, name.toRawUTF8());
+
+        for (auto size : sizes)
+        {
+            nvgFontSize (nvg, size);
+            missing += nvgTextPrewarm (nvg, devicePixelRatio, str.toRawUTF8(), nullptr);
+        }
+    }
+
+    nvgRestore (nvg);
+
+    // Loading fonts above switches the current glyph mapping.
+    currentGlyphToCharMap = glyphToCharMap;
+
+    return missing;
 }
 
 bool NanovgGraphicsContext::loadFontFromResources (const String& typefaceName)
@@ -371,38 +673,64 @@ bool NanovgGraphicsContext::loadFontFromResources (const String& typefaceName)
 
     if (it != loadedFonts.end())
     {
-        currentGlyphToCharMap = &it->second;
+        currentGlyphToCharMap = it->second.get();
         return true; // Already loaded
     }
 
+    int id {-1};
+    const void* data {};
+    size_t dataSize {};
+    std::unique_ptr<MemoryMappedFile> mappedFile {};
+
     int size{};
     String resName {typefaceName + ".ttf"};
     const auto* ptr {getResourceByFileName(resName, size)};
+    const auto fontFile {fontFiles.find (typefaceName)};
 
     if (ptr != nullptr && size > 0)
     {
-        const int id = nvgCreateFontMem (nvg, typefaceName.toRawUTF8(),
-                                         (unsigned char*)ptr, size,
-                                         0 // Tell nvg to take ownership of the font data
-                                        );
+        id = nvgCreateFontMem (nvg, typefaceName.toRawUTF8(),
+                               (unsigned char*)ptr, size,
+                               0 // Tell nvg to take ownership of the font data
+                              );
+        data = ptr;
+        dataSize = (size_t) size;
+    }
+    else if (fontFile != fontFiles.end())
+    {
+        // Nanovg and the glyph map both map the file, sharing the same pages.
+        id = nvgCreateFontMapped (nvg, typefaceName.toRawUTF8(),
+                                  fontFile->second.getFullPathName().toRawUTF8());
 
-        if (id >= 0)
-        {
-            Font tmpFont (Typeface::createSystemTypefaceFor (ptr, size));
-            loadedFonts[typefaceName] = getGlyphToCharMapForFont (tmpFont);
-            currentGlyphToCharMap = &loadedFonts[typefaceName];
-            return true;
-        }
+        mappedFile = std::make_unique<MemoryMappedFile> (fontFile->second, MemoryMappedFile::readOnly);
+        data = mappedFile->getData();
+        dataSize = mappedFile->getSize();
     }
     else
     {
         std::cerr << "Unabled to load " << resName << "\n";
+        return false;
     }
 
-    return false;
+    if (id >= 0 && data != nullptr)
+    {
+        auto glyphToCharMap = std::make_unique<GlyphToCharMap> (data, dataSize, std::move (mappedFile));
+        currentGlyphToCharMap = glyphToCharMap.get();
+        loadedFonts[typefaceName] = std::move (glyphToCharMap);
+        return true;
+    }
 
+    return false;
 }
 
+void NanovgGraphicsContext::registerFontFile (const String& typefaceName, const File& file)
+{
+    jassert (file.existsAsFile());
+    fontFiles[typefaceName] = file;
+
+    // Fonts resolved before may have fallen back to the default typeface.
+    fontFaces.clear();
+}
 
 void NanovgGraphicsContext::applyFillType()
 {
@@ -457,17 +785,38 @@ void NanovgGraphicsContext::applyStrokeType()
 
 void NanovgGraphicsContext::applyFont()
 {
-    String name {font.getTypeface()->getName()};
-    name << "-" << font.getTypefaceStyle();
+    const auto& face = getFontFace (font);
 
-    if (loadFontFromResources (name))
-        nvgFontFace (nvg, name.toUTF8());
-    else
-        nvgFontFace (nvg, defaultTypefaceName.toRawUTF8());
+    nvgFontFaceId (nvg, face.id);
+    currentGlyphToCharMap = face.glyphToCharMap;
 
     nvgFontSize (nvg, font.getHeight());
 }
 
+const NanovgGraphicsContext::FontFace& NanovgGraphicsContext::getFontFace (const Font& f)
+{
+    const auto typeface = f.getTypeface();
+    const auto& typefaceName = typeface->getName();
+    const auto style = f.getTypefaceStyle();
+
+    for (const auto& face : fontFaces)
+    {
+        if (face.typefaceName == typefaceName && face.style == style)
+            return face;
+    }
+
+    String name {typefaceName + "-" + style};
+
+    if (! loadFontFromResources (name))
+    {
+        name = defaultTypefaceName;
+        loadFontFromResources (name);
+    }
+
+    fontFaces.push_back ({ typefaceName, style, nvgFindFont (nvg, name.toRawUTF8()), currentGlyphToCharMap });
+    return fontFaces.back();
+}
+
 int NanovgGraphicsContext::getNvgImageId (const Image& image)
 {
     int id = -1;
@@ -532,6 +881,7 @@ void NanovgGraphicsContext::reduceImageCache()
         {
             nvgDeleteImage (nvg, it->second.id);
             it = images.erase(it);
+            ++imageCacheGeneration;
         }
         else
         {
@@ -541,24 +891,113 @@ void NanovgGraphicsContext::reduceImageCache()
     }
 }
 
-NanovgGraphicsContext::GlyphToCharMap NanovgGraphicsContext::getGlyphToCharMapForFont (const Font& f)
+//==============================================================================
+
+NanovgDisplayListCache::NanovgDisplayListCache (Component& componentToCache)
+    : component {componentToCache}
+{
+}
+
+NanovgDisplayListCache::~NanovgDisplayListCache()
+{
+    releaseResources();
+}
+
+void NanovgDisplayListCache::paint (Graphics& g)
+{
+    // Once a component has a cached image, JUCE leaves applying its opacity to it.
+    const auto alpha {component.getAlpha()};
+
+    if (alpha < 1.0f)
+    {
+        g.beginTransparencyLayer (alpha);
+        paintCached (g);
+        g.endTransparencyLayer();
+    }
+    else
+    {
+        paintCached (g);
+    }
+}
+
+void NanovgDisplayListCache::paintCached (Graphics& g)
 {
-    NanovgGraphicsContext::GlyphToCharMap map;
+    auto* context {dynamic_cast<NanovgGraphicsContext*> (&g.getInternalContext())};
+
+    if (context == nullptr)
+    {
+        component.paintEntireComponent (g, true);
+        return;
+    }
+
+    if (nvg != context->getNvgContext())
+    {
+        releaseResources();
+        nvg = context->getNvgContext();
+    }
 
-    if (auto* tf = f.getTypeface())
+    if (displayList == nullptr)
+        displayList = nvgCreateDisplayList (nvg);
+
+    if (displayList == nullptr)
     {
-        Array<int> glyphs;
-        Array<float> offsets;
-        tf->getGlyphPositions (allPrintableAsciiCharacters, glyphs, offsets);
+        component.paintEntireComponent (g, true);
+        return;
+    }
+
+    float xform[6]{};
+    nvgCurrentTransform (nvg, xform);
+
+    // Fringes are tessellated for the scale the list is recorded at.
+    const auto scale {std::sqrt (std::abs (xform[0] * xform[3] - xform[1] * xform[2]))};
+
+    if (valid
+        && scale == recordedScale
+        && imageCacheGeneration == context->getImageCacheGeneration()
+        && nvgReplay (nvg, displayList))
+        return;
+
+    // Record the whole component unclipped and opaque,
+    // the clip and opacity are applied when replaying.
+    nvgSave (nvg);
+    nvgResetScissor (nvg);
+    nvgScissor (nvg, 0.0f, 0.0f, (float) component.getWidth(), (float) component.getHeight());
+    nvgGlobalAlpha (nvg, 1.0f);
 
-        // Make sure we get all the glyphs for the printable characters
-        jassert (glyphs.size() == allPrintableAsciiCharacters.length());
+    nvgBeginRecord (nvg, displayList);
+    component.paintEntireComponent (g, true);
+    nvgEndRecord (nvg);
 
-        const auto* wstr = allPrintableAsciiCharacters.toWideCharPointer();
+    nvgRestore (nvg);
+
+    recordedScale = scale;
+    imageCacheGeneration = context->getImageCacheGeneration();
+    valid = true;
 
-        for (int i = 0; i < allPrintableAsciiCharacters.length(); ++i)
-            map[glyphs[i]] = wstr[i];
+    if (! nvgReplay (nvg, displayList))
+    {
+        valid = false;
+        component.paintEntireComponent (g, true);
     }
+}
+
+bool NanovgDisplayListCache::invalidateAll()
+{
+    valid = false;
+    return true;
+}
+
+bool NanovgDisplayListCache::invalidate (const Rectangle<int>&)
+{
+    valid = false;
+    return true;
+}
+
+void NanovgDisplayListCache::releaseResources()
+{
+    if (displayList != nullptr)
+        nvgDeleteDisplayList (nvg, displayList);
 
-    return map;
+    displayList = nullptr;
+    valid = false;
 }
@@ -63,6 +63,37 @@ public:
 
     void removeCachedImages();
 
+    /** Rasterizes glyphs of the given typefaces and sizes into the font atlas
+        ahead of drawing, so that the first frames do not stall on it.
+
+        Glyphs are rasterized at the sizes the current nanovg transform gives
+        in a frame of the given device pixel ratio, whether or not a frame is
+        being rendered. When no characters are given, all printable ASCII
+        characters are used.
+
+        @returns Number of glyphs that could not be added to the atlas.
+    */
+    int prewarmGlyphs (const StringArray& typefaceNames,
+                       const Array<float>& sizes,
+                       const String& characters = {},
+                       float devicePixelRatio = 1.0f);
+
+    /** Makes a font file available under the given typeface name, as
+        "<name>-<style>" like the fonts embedded in BinaryData.
+
+        The font is loaded on first use by memory mapping the file, so only
+        the parts of the file that are drawn from take memory, shared with
+        other processes using the same file.
+    */
+    void registerFontFile (const String& typefaceName, const File& file);
+
+    NVGcontext* getNvgContext() const noexcept { return nvg; }
+
+    /** Returns a counter that changes whenever cached images are deleted,
+        so that recorded drawing referring to them can be discarded.
+    */
+    int getImageCacheGeneration() const noexcept { return imageCacheGeneration; }
+
     const static String defaultTypefaceName;
 
     const static int imageCacheSize;
@@ -85,14 +116,27 @@ private:
     FillType fillType{};
     Font font{};
 
-    // Mapping glyph number to a character
-    using GlyphToCharMap = std::map<int, wchar_t>;
-
-    GlyphToCharMap getGlyphToCharMapForFont (const Font& f);
+    // Mapping glyph numbers of a font to characters, filled in as glyphs are drawn
+    class GlyphToCharMap;
 
     // Mapping font names to glyph-to-character tables
-    std::map<String, GlyphToCharMap> loadedFonts{};
-    const GlyphToCharMap* currentGlyphToCharMap{};
+    std::map<String, std::unique_ptr<GlyphToCharMap>> loadedFonts{};
+    std::map<String, File> fontFiles{};
+    GlyphToCharMap* currentGlyphToCharMap{};
+
+    // Nanovg font resolved for a JUCE typeface name and style,
+    // so that setting a font does not build and look up names.
+    struct FontFace
+    {
+        String typefaceName;
+        String style;
+        int id {-1};
+        GlyphToCharMap* glyphToCharMap {};
+    };
+
+    std::vector<FontFace> fontFaces{};
+
+    const FontFace& getFontFace (const Font& f);
 
     // Tracking images mapped tomtextures.
     struct NvgImage
@@ -102,4 +146,45 @@ private:
     };
 
     std::map<uint64, NvgImage> images;
+    int imageCacheGeneration{};
+
+    // Path commands handed to nanovg, reused between calls.
+    std::vector<float> pathCommands{};
+};
+
+//==============================================================================
+
+/**
+    Cached component image keeping the nanovg drawing of a component
+    in a display list, that is replayed until the component is repainted.
+
+    This saves building and tessellating the paths of components that do
+    not change between frames. Attach it to a component painted by a
+    NanovgGraphicsContext with Component::setCachedComponentImage().
+
+    @note The cache must be released before the nanovg context is deleted.
+*/
+class NanovgDisplayListCache : public CachedComponentImage
+{
+public:
+    explicit NanovgDisplayListCache (Component& componentToCache);
+    ~NanovgDisplayListCache();
+
+    // juce::CachedComponentImage
+    void paint (Graphics&) override;
+    bool invalidateAll() override;
+    bool invalidate (const Rectangle<int>&) override;
+    void releaseResources() override;
+
+private:
+
+    void paintCached (Graphics& g);
+
+    Component& component;
+
+    NVGcontext* nvg{};
+    NVGdisplayList* displayList{};
+    float recordedScale{};
+    int imageCacheGeneration{};
+    bool valid{};
 };
@@ -0,0 +1,190 @@
+//
+//  Copyright (C) 2022 Arthur Benilov <arthur.benilov@gmail.com>
+//
+
+// Fills random cubic bezier curves, 3 to 2000 px in size, through a nanovg
+// context without a GPU back-end and checks that the polyline nanovg
+// flattens each curve into stays within the tessellation tolerance of the
+// curve. The time taken per curve is printed as a throughput benchmark.
+//
+// The test is built twice, with the SIMD evaluation of curve points and
+// with NVG_NO_SIMD, so that both paths are checked and can be compared.
+
+#include "nanovg.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+//==============================================================================
+
+constexpr int numCurves {2000};
+constexpr int numSamples {4000};  // Points of each curve checked against its polyline.
+constexpr int numRepeats {50};
+constexpr float tessTol {0.25f};  // Tolerance of a context drawn at a pixel ratio of 1.
+
+/** Render back-end keeping the fill vertices of the last path instead of drawing them. */
+struct CaptureRenderer
+{
+    std::vector<NVGvertex> vertices;
+};
+
+static CaptureRenderer renderer;
+
+static int captureCreate (void*) { return 1; }
+static int captureCreateTexture (void*, int, int, int, int, const unsigned char*) { return 1; }
+static int captureDeleteTexture (void*, int) { return 1; }
+static int captureUpdateTexture (void*, int, int, int, int, int, const unsigned char*) { return 1; }
+
+static int captureGetTextureSize (void*, int, int* w, int* h)
+{
+    *w = *h = 512;
+    return 1;
+}
+
+static void captureViewport (void*, float, float, float) {}
+static void captureCancel (void*) {}
+static void captureFlush (void*) {}
+
+static void captureFill (void* uptr, NVGpaint*, NVGcompositeOperationState, NVGscissor*, float,
+                         const float*, const NVGpath* paths, int npaths)
+{
+    auto* r = (CaptureRenderer*) uptr;
+
+    r->vertices.clear();
+
+    if (npaths == 1)
+        r->vertices.assign (paths[0].fill, paths[0].fill + paths[0].nfill);
+}
+
+static void captureStroke (void*, NVGpaint*, NVGcompositeOperationState, NVGscissor*, float,
+                           float, const NVGpath*, int) {}
+
+static void captureTriangles (void*, NVGpaint*, NVGcompositeOperationState, NVGscissor*,
+                              const NVGvertex*, int) {}
+
+static void captureDelete (void*) {}
+
+static NVGcontext* createCaptureContext()
+{
+    NVGparams params {};
+    params.userPtr = &renderer;
+    params.edgeAntiAlias = 0;  // Without fringes the fill vertices are the flattened points.
+    params.renderCreate = captureCreate;
+    params.renderCreateTexture = captureCreateTexture;
+    params.renderDeleteTexture = captureDeleteTexture;
+    params.renderUpdateTexture = captureUpdateTexture;
+    params.renderGetTextureSize = captureGetTextureSize;
+    params.renderViewport = captureViewport;
+    params.renderCancel = captureCancel;
+    params.renderFlush = captureFlush;
+    params.renderFill = captureFill;
+    params.renderStroke = captureStroke;
+    params.renderTriangles = captureTriangles;
+    params.renderDelete = captureDelete;
+
+    return nvgCreateInternal (&params);
+}
+
+//==============================================================================
+
+static double distanceToSegment (double px, double py, const NVGvertex& a, const NVGvertex& b)
+{
+    const double dx {b.x - a.x};
+    const double dy {b.y - a.y};
+    const double len {dx * dx + dy * dy};
+    const double t {len > 0.0 ? std::clamp (((px - a.x) * dx + (py - a.y) * dy) / len, 0.0, 1.0) : 0.0};
+
+    return std::hypot (a.x + t * dx - px, a.y + t * dy - py);
+}
+
+/** Returns the largest distance from points of the curve to the polyline it was flattened into. */
+static double getMaxDeviation (const float* c, const std::vector<NVGvertex>& polyline)
+{
+    double maxDeviation {0.0};
+
+    for (int i = 0; i <= numSamples; ++i)
+    {
+        const double t {(double) i / numSamples};
+        const double u {1.0 - t};
+        const double x {u * u * u * c[0] + 3.0 * u * u * t * c[2] + 3.0 * u * t * t * c[4] + t * t * t * c[6]};
+        const double y {u * u * u * c[1] + 3.0 * u * u * t * c[3] + 3.0 * u * t * t * c[5] + t * t * t * c[7]};
+
+        // The fill closes the polyline back to its start, that segment is not part of the curve.
+        double deviation {polyline.size() == 1 ? std::hypot (x - polyline[0].x, y - polyline[0].y) : 1.0e30};
+
+        for (size_t j = 1; j < polyline.size(); ++j)
+            deviation = std::min (deviation, distanceToSegment (x, y, polyline[j - 1], polyline[j]));
+
+        maxDeviation = std::max (maxDeviation, deviation);
+    }
+
+    return maxDeviation;
+}
+
+static void fillCurve (NVGcontext* nvg, const float* c)
+{
+    nvgBeginPath (nvg);
+    nvgMoveTo (nvg, c[0], c[1]);
+    nvgBezierTo (nvg, c[2], c[3], c[4], c[5], c[6], c[7]);
+    nvgFill (nvg);
+}
+
+int main()
+{
+    auto* nvg = createCaptureContext();
+
+    if (nvg == nullptr)
+    {
+        std::cout << "Unable to create nanovg context" << std::endl;
+        return 1;
+    }
+
+    std::mt19937 rng {1};
+    std::vector<float> curves (numCurves * 8);
+
+    for (int i = 0; i < numCurves; ++i)
+    {
+        const float sizes[] {2000.0f, 200.0f, 20.0f, 3.0f};
+        std::uniform_real_distribution<float> coordinate {0.0f, sizes[i % 4]};
+
+        for (int k = 0; k < 8; ++k)
+            curves[(size_t) (i * 8 + k)] = coordinate (rng) + 100.0f;
+    }
+
+    nvgBeginFrame (nvg, 2400.0f, 2400.0f, 1.0f);
+
+    double maxDeviation {0.0};
+    long numPoints {0};
+
+    for (int i = 0; i < numCurves; ++i)
+    {
+        fillCurve (nvg, &curves[(size_t) i * 8]);
+        maxDeviation = std::max (maxDeviation, getMaxDeviation (&curves[(size_t) i * 8], renderer.vertices));
+        numPoints += (long) renderer.vertices.size();
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+
+    for (int r = 0; r < numRepeats; ++r)
+        for (int i = 0; i < numCurves; ++i)
+            fillCurve (nvg, &curves[(size_t) i * 8]);
+
+    const std::chrono::duration<double, std::micro> elapsed {std::chrono::steady_clock::now() - start};
+
+    nvgCancelFrame (nvg);
+    nvgDeleteInternal (nvg);
+
+    const bool passed {maxDeviation <= tessTol};
+
+    std::cout << "max deviation " << maxDeviation << " px (tolerance " << tessTol << " px), "
+              << (double) numPoints / numCurves << " points per curve, "
+              << elapsed.count() / (numRepeats * numCurves) << " us per curve" << std::endl;
+
+    std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,212 @@
+//
+//  Copyright (C) 2022 Arthur Benilov <arthur.benilov@gmail.com>
+//
+
+// Draws a busy frame of filled and stroked curves through a nanovg context
+// without a GPU back-end, once tessellating each path as it is drawn and
+// once with nvgDeferTessellation(), and checks that the back-end receives
+// the same calls with the same vertices in the same order. The best time
+// taken by a frame in each mode is printed as a benchmark.
+//
+// The test is built twice, with the worker threads of nanovg and with
+// NVG_TESS_THREADS set to 0, which tessellates deferred calls on the calling
+// thread. Comparing the deferred frame times of both builds shows how
+// tessellation scales with the cores of the machine.
+
+#include "nanovg.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+//==============================================================================
+
+constexpr int numShapes {3000};
+constexpr int numFrames {20};
+
+/** Render back-end keeping every fill and stroke vertex of the frame instead of drawing them. */
+struct CaptureRenderer
+{
+    std::vector<NVGvertex> vertices;
+    std::vector<int> calls;  // Type and vertex count of each call.
+    bool capturing {true};  // Frames being timed only count their calls.
+};
+
+static CaptureRenderer renderer;
+
+static int captureCreate (void*) { return 1; }
+static int captureCreateTexture (void*, int, int, int, int, const unsigned char*) { return 1; }
+static int captureDeleteTexture (void*, int) { return 1; }
+static int captureUpdateTexture (void*, int, int, int, int, int, const unsigned char*) { return 1; }
+
+static int captureGetTextureSize (void*, int, int* w, int* h)
+{
+    *w = *h = 512;
+    return 1;
+}
+
+static void captureViewport (void*, float, float, float) {}
+static void captureCancel (void*) {}
+static void captureFlush (void*) {}
+
+static void capturePaths (CaptureRenderer* r, int type, const NVGpath* paths, int npaths)
+{
+    const auto numVertices = r->vertices.size();
+
+    if (! r->capturing)
+    {
+        r->calls.push_back (type);
+        return;
+    }
+
+    for (int i = 0; i < npaths; ++i)
+    {
+        r->vertices.insert (r->vertices.end(), paths[i].fill, paths[i].fill + paths[i].nfill);
+        r->vertices.insert (r->vertices.end(), paths[i].stroke, paths[i].stroke + paths[i].nstroke);
+    }
+
+    r->calls.push_back (type);
+    r->calls.push_back ((int) (r->vertices.size() - numVertices));
+}
+
+static void captureFill (void* uptr, NVGpaint*, NVGcompositeOperationState, NVGscissor*, float,
+                         const float*, const NVGpath* paths, int npaths)
+{
+    capturePaths ((CaptureRenderer*) uptr, 1, paths, npaths);
+}
+
+static void captureStroke (void* uptr, NVGpaint*, NVGcompositeOperationState, NVGscissor*, float,
+                           float, const NVGpath* paths, int npaths)
+{
+    capturePaths ((CaptureRenderer*) uptr, 2, paths, npaths);
+}
+
+static void captureTriangles (void*, NVGpaint*, NVGcompositeOperationState, NVGscissor*,
+                              const NVGvertex*, int) {}
+
+static void captureDelete (void*) {}
+
+static NVGcontext* createCaptureContext()
+{
+    NVGparams params {};
+    params.userPtr = &renderer;
+    params.edgeAntiAlias = 1;
+    params.renderCreate = captureCreate;
+    params.renderCreateTexture = captureCreateTexture;
+    params.renderDeleteTexture = captureDeleteTexture;
+    params.renderUpdateTexture = captureUpdateTexture;
+    params.renderGetTextureSize = captureGetTextureSize;
+    params.renderViewport = captureViewport;
+    params.renderCancel = captureCancel;
+    params.renderFlush = captureFlush;
+    params.renderFill = captureFill;
+    params.renderStroke = captureStroke;
+    params.renderTriangles = captureTriangles;
+    params.renderDelete = captureDelete;
+
+    return nvgCreateInternal (&params);
+}
+
+//==============================================================================
+
+/** Draws curves of 8 bezier segments, filled, stroked or both, with every join and cap. */
+static void drawFrame (NVGcontext* nvg)
+{
+    std::mt19937 rng {1};
+    std::uniform_real_distribution<float> coordinate {0.0f, 800.0f};
+
+    nvgBeginFrame (nvg, 800.0f, 600.0f, 1.5f);
+
+    for (int i = 0; i < numShapes; ++i)
+    {
+        nvgSave (nvg);
+        nvgRotate (nvg, coordinate (rng) * 0.0005f);
+
+        nvgBeginPath (nvg);
+        nvgMoveTo (nvg, coordinate (rng), coordinate (rng));
+
+        for (int k = 0; k < 8; ++k)
+            nvgBezierTo (nvg, coordinate (rng), coordinate (rng), coordinate (rng),
+                         coordinate (rng), coordinate (rng), coordinate (rng));
+
+        if (i % 3 == 0)
+            nvgClosePath (nvg);
+
+        nvgStrokeWidth (nvg, 1.0f + (float) (i % 5));
+        nvgLineJoin (nvg, i % 3 == 0 ? NVG_ROUND : (i % 3 == 1 ? NVG_MITER : NVG_BEVEL));
+        nvgLineCap (nvg, i % 4 == 0 ? NVG_ROUND : NVG_BUTT);
+
+        if (i % 4 != 3)
+            nvgFill (nvg);
+
+        if (i % 2 == 0)
+            nvgStroke (nvg);
+
+        nvgRestore (nvg);
+    }
+
+    nvgEndFrame (nvg);
+}
+
+/** Returns the best time taken by a frame in milliseconds, then captures one more frame. */
+static double measureFrames (NVGcontext* nvg)
+{
+    double best {1.0e30};
+
+    renderer.capturing = false;
+
+    for (int i = 0; i < numFrames; ++i)
+    {
+        renderer.calls.clear();
+
+        const auto start = std::chrono::steady_clock::now();
+        drawFrame (nvg);
+        const std::chrono::duration<double, std::milli> elapsed {std::chrono::steady_clock::now() - start};
+        best = std::min (best, elapsed.count());
+    }
+
+    renderer.capturing = true;
+    renderer.vertices.clear();
+    renderer.calls.clear();
+    drawFrame (nvg);
+
+    return best;
+}
+
+int main()
+{
+    auto* nvg = createCaptureContext();
+
+    if (nvg == nullptr)
+    {
+        std::cout << "Unable to create nanovg context" << std::endl;
+        return 1;
+    }
+
+    const double immediateTime {measureFrames (nvg)};
+    const auto immediate = renderer;
+
+    nvgDeferTessellation (nvg, 1);
+    const double deferredTime {measureFrames (nvg)};
+    nvgDeferTessellation (nvg, 0);
+
+    nvgDeleteInternal (nvg);
+
+    const bool passed {! immediate.calls.empty()
+                       && renderer.calls == immediate.calls
+                       && renderer.vertices.size() == immediate.vertices.size()
+                       && std::memcmp (renderer.vertices.data(), immediate.vertices.data(),
+                                       sizeof (NVGvertex) * immediate.vertices.size()) == 0};
+
+    std::cout << immediate.calls.size() / 2 << " calls, " << immediate.vertices.size() << " vertices, "
+              << std::thread::hardware_concurrency() << " cores" << std::endl;
+    std::cout << "immediate " << immediateTime << " ms, deferred " << deferredTime << " ms per frame" << std::endl;
+    std::cout << "deferred calls " << (passed ? "match" : "differ") << std::endl;
+
+    std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
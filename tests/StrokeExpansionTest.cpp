@@ -0,0 +1,239 @@
+//
+//  Copyright (C) 2022 Arthur Benilov <arthur.benilov@gmail.com>
+//
+
+// Strokes synthetic polylines through a nanovg context without a GPU
+// back-end and prints the time taken to expand each of them, as a
+// benchmark of the join and stroke expansion loops. The polylines are a
+// jagged random walk, as drawn for envelopes and automation lanes, a smooth
+// curve made of short segments and a closed jagged outline, each stroked
+// with every join and cap.
+//
+// The test is built twice, with the SIMD joins and with NVG_NO_SIMD. The
+// scalar build writes the vertices it generates to the file given with
+// --write and the SIMD build checks with --compare that its vertices are
+// the same bit for bit.
+
+#include "nanovg.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+//==============================================================================
+
+constexpr int numRepeats {200};
+
+/** Render back-end keeping the stroke vertices of the last path instead of drawing them. */
+struct CaptureRenderer
+{
+    std::vector<NVGvertex> vertices;
+};
+
+static CaptureRenderer renderer;
+
+static int captureCreate (void*) { return 1; }
+static int captureCreateTexture (void*, int, int, int, int, const unsigned char*) { return 1; }
+static int captureDeleteTexture (void*, int) { return 1; }
+static int captureUpdateTexture (void*, int, int, int, int, int, const unsigned char*) { return 1; }
+
+static int captureGetTextureSize (void*, int, int* w, int* h)
+{
+    *w = *h = 512;
+    return 1;
+}
+
+static void captureViewport (void*, float, float, float) {}
+static void captureCancel (void*) {}
+static void captureFlush (void*) {}
+
+static void captureFill (void*, NVGpaint*, NVGcompositeOperationState, NVGscissor*, float,
+                         const float*, const NVGpath*, int) {}
+
+static void captureStroke (void* uptr, NVGpaint*, NVGcompositeOperationState, NVGscissor*, float,
+                           float, const NVGpath* paths, int npaths)
+{
+    auto* r = (CaptureRenderer*) uptr;
+
+    r->vertices.clear();
+
+    for (int i = 0; i < npaths; ++i)
+        r->vertices.insert (r->vertices.end(), paths[i].stroke, paths[i].stroke + paths[i].nstroke);
+}
+
+static void captureTriangles (void*, NVGpaint*, NVGcompositeOperationState, NVGscissor*,
+                              const NVGvertex*, int) {}
+
+static void captureDelete (void*) {}
+
+static NVGcontext* createCaptureContext()
+{
+    NVGparams params {};
+    params.userPtr = &renderer;
+    params.edgeAntiAlias = 1;
+    params.renderCreate = captureCreate;
+    params.renderCreateTexture = captureCreateTexture;
+    params.renderDeleteTexture = captureDeleteTexture;
+    params.renderUpdateTexture = captureUpdateTexture;
+    params.renderGetTextureSize = captureGetTextureSize;
+    params.renderViewport = captureViewport;
+    params.renderCancel = captureCancel;
+    params.renderFlush = captureFlush;
+    params.renderFill = captureFill;
+    params.renderStroke = captureStroke;
+    params.renderTriangles = captureTriangles;
+    params.renderDelete = captureDelete;
+
+    return nvgCreateInternal (&params);
+}
+
+//==============================================================================
+
+struct Polyline
+{
+    const char* name;
+    std::vector<float> points;
+    bool closed;
+};
+
+static std::vector<Polyline> createPolylines()
+{
+    std::vector<Polyline> polylines;
+    std::mt19937 rng {1};
+    std::uniform_real_distribution<float> step {-12.0f, 12.0f};
+
+    Polyline walk {"random walk", {}, false};
+    float y {500.0f};
+
+    for (int i = 0; i < 5000; ++i)
+    {
+        y = std::clamp (y + step (rng), 100.0f, 900.0f);
+        walk.points.insert (walk.points.end(), {10.0f + 0.19f * (float) i, y});
+    }
+
+    polylines.push_back (walk);
+
+    Polyline curve {"smooth curve", {}, false};
+
+    for (int i = 0; i < 8600; ++i)
+        curve.points.insert (curve.points.end(), {10.0f + 0.11f * (float) i, 500.0f + 300.0f * std::sin ((float) i * 0.004f)});
+
+    polylines.push_back (curve);
+
+    Polyline outline {"closed outline", {}, true};
+
+    for (int i = 0; i < 3000; ++i)
+    {
+        const float a {6.2831853f * (float) i / 3000.0f};
+        const float radius {350.0f + step (rng) * 2.0f};
+        outline.points.insert (outline.points.end(), {500.0f + radius * std::cos (a), 500.0f + radius * std::sin (a)});
+    }
+
+    polylines.push_back (outline);
+
+    return polylines;
+}
+
+static void strokePolyline (NVGcontext* nvg, const Polyline& polyline)
+{
+    nvgBeginPath (nvg);
+    nvgMoveTo (nvg, polyline.points[0], polyline.points[1]);
+
+    for (size_t i = 2; i < polyline.points.size(); i += 2)
+        nvgLineTo (nvg, polyline.points[i], polyline.points[i + 1]);
+
+    if (polyline.closed)
+        nvgClosePath (nvg);
+
+    nvgStroke (nvg);
+}
+
+int main (int argc, char* argv[])
+{
+    std::string writePath;
+    std::string comparePath;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (std::strcmp (argv[i], "--write") == 0)
+            writePath = argv[i + 1];
+        else if (std::strcmp (argv[i], "--compare") == 0)
+            comparePath = argv[i + 1];
+    }
+
+    auto* nvg = createCaptureContext();
+
+    if (nvg == nullptr)
+    {
+        std::cout << "Unable to create nanovg context" << std::endl;
+        return 1;
+    }
+
+    const auto polylines = createPolylines();
+    const int joins[] {NVG_MITER, NVG_BEVEL, NVG_ROUND};
+    const int caps[] {NVG_BUTT, NVG_SQUARE, NVG_ROUND};
+    const char* joinNames[] {"miter", "bevel", "round"};
+
+    std::vector<NVGvertex> allVertices;
+
+    nvgBeginFrame (nvg, 1000.0f, 1000.0f, 1.0f);
+    nvgStrokeWidth (nvg, 2.0f);
+
+    for (const auto& polyline : polylines)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            nvgLineJoin (nvg, joins[i]);
+            nvgLineCap (nvg, caps[i]);
+
+            strokePolyline (nvg, polyline);
+            allVertices.insert (allVertices.end(), renderer.vertices.begin(), renderer.vertices.end());
+
+            double best {1.0e30};
+
+            for (int r = 0; r < numRepeats; ++r)
+            {
+                const auto start = std::chrono::steady_clock::now();
+                strokePolyline (nvg, polyline);
+                const std::chrono::duration<double, std::micro> elapsed {std::chrono::steady_clock::now() - start};
+                best = std::min (best, elapsed.count());
+            }
+
+            std::cout << polyline.name << ", " << joinNames[i] << ": "
+                      << renderer.vertices.size() << " vertices, " << best << " us" << std::endl;
+        }
+    }
+
+    nvgCancelFrame (nvg);
+    nvgDeleteInternal (nvg);
+
+    const auto* bytes = (const char*) allVertices.data();
+    const auto numBytes = allVertices.size() * sizeof (NVGvertex);
+    bool passed {true};
+
+    if (! writePath.empty())
+    {
+        std::ofstream file (writePath, std::ios::binary);
+        file.write (bytes, (std::streamsize) numBytes);
+        passed = file.good();
+    }
+
+    if (! comparePath.empty())
+    {
+        std::ifstream file (comparePath, std::ios::binary);
+        const std::vector<char> reference {std::istreambuf_iterator<char> (file), std::istreambuf_iterator<char>()};
+
+        passed = reference.size() == numBytes && std::memcmp (reference.data(), bytes, numBytes) == 0;
+        std::cout << "vertices " << (passed ? "match" : "differ from") << " " << comparePath << std::endl;
+    }
+
+    std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,322 @@
+//
+//  Copyright (C) 2022 Arthur Benilov <arthur.benilov@gmail.com>
+//
+
+// Draws mixed ASCII and non-ASCII text through NanovgGraphicsContext for
+// several frames and checks that, once fonts and glyphs are loaded, a frame
+// of text does not allocate. nanovg runs without a GPU back-end, the vertices
+// it emits are captured instead, so that the character ranges drawn by
+// drawTextLayout() can be compared to the same substrings drawn directly.
+//
+// Allocations are counted in two places: operator new, which covers the
+// bridge code and JUCE, and the bx allocator given to the nanovg context,
+// which covers the command, path, vertex and text buffers of nanovg.
+// fontstash and stb_truetype still allocate with malloc, but only when the
+// atlas grows or a glyph is rasterized, so texture creations and updates
+// are counted as well.
+
+#include <JuceHeader.h>
+#include "NanovgGraphics.h"
+
+#include <bx/allocator.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+//==============================================================================
+
+static std::atomic<int> numAllocations {0};
+
+void* operator new (std::size_t size)
+{
+    ++numAllocations;
+
+    if (auto* p = std::malloc (size != 0 ? size : 1))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+void operator delete (void* p) noexcept { std::free (p); }
+void operator delete (void* p, std::size_t) noexcept { std::free (p); }
+
+/** Allocator of the nanovg context, counting every allocation and reallocation. */
+struct CountingAllocator : public bx::DefaultAllocator
+{
+    void* realloc (void* ptr, size_t size, size_t align, const char* file, uint32_t line) override
+    {
+        if (size != 0)
+            ++numAllocations;
+
+        return bx::DefaultAllocator::realloc (ptr, size, align, file, line);
+    }
+
+    std::atomic<int> numAllocations {0};
+};
+
+static CountingAllocator allocator;
+
+/** Returns the number of allocations made so far, on the heap and by nanovg. */
+static int getNumAllocations()
+{
+    return ::numAllocations.load() + allocator.numAllocations.load();
+}
+
+//==============================================================================
+
+constexpr int numFrames {8};
+constexpr int numWarmUpFrames {2};  // Fonts, glyph maps and the atlas fill in here.
+constexpr int maxVertices {1 << 16};
+constexpr int maxTextures {16};
+
+/** Render back-end keeping the vertices of text instead of drawing them. */
+struct CaptureRenderer
+{
+    NVGvertex vertices[maxVertices];
+    int numVertices {0};
+    int numCalls {0};
+
+    int textureSizes[maxTextures][2] {};
+    int numTextures {0};
+    int numTextureUpdates {0};
+
+    void clear()
+    {
+        numVertices = 0;
+        numCalls = 0;
+    }
+
+    bool matches (const CaptureRenderer& other) const
+    {
+        return numCalls == other.numCalls
+            && numVertices == other.numVertices
+            && std::memcmp (vertices, other.vertices, sizeof (NVGvertex) * (size_t) numVertices) == 0;
+    }
+};
+
+static CaptureRenderer renderer;
+static CaptureRenderer textLayout;
+
+static int captureCreate (void*) { return 1; }
+
+static int captureCreateTexture (void* uptr, int, int w, int h, int, const unsigned char*)
+{
+    auto* r = (CaptureRenderer*) uptr;
+
+    if (r->numTextures == maxTextures)
+        return 0;
+
+    r->textureSizes[r->numTextures][0] = w;
+    r->textureSizes[r->numTextures][1] = h;
+    ++r->numTextureUpdates;
+    return ++r->numTextures;
+}
+
+static int captureDeleteTexture (void*, int) { return 1; }
+
+static int captureUpdateTexture (void* uptr, int, int, int, int, int, const unsigned char*)
+{
+    ++((CaptureRenderer*) uptr)->numTextureUpdates;
+    return 1;
+}
+
+static int captureGetTextureSize (void* uptr, int image, int* w, int* h)
+{
+    auto* r = (CaptureRenderer*) uptr;
+
+    if (image < 1 || image > r->numTextures)
+        return 0;
+
+    *w = r->textureSizes[image - 1][0];
+    *h = r->textureSizes[image - 1][1];
+    return 1;
+}
+
+static void captureViewport (void*, float, float, float) {}
+static void captureCancel (void*) {}
+static void captureFlush (void*) {}
+
+static void captureFill (void*, NVGpaint*, NVGcompositeOperationState, NVGscissor*, float,
+                         const float*, const NVGpath*, int) {}
+
+static void captureStroke (void*, NVGpaint*, NVGcompositeOperationState, NVGscissor*, float,
+                           float, const NVGpath*, int) {}
+
+static void captureTriangles (void* uptr, NVGpaint*, NVGcompositeOperationState, NVGscissor*,
+                              const NVGvertex* verts, int nverts)
+{
+    auto* r = (CaptureRenderer*) uptr;
+
+    ++r->numCalls;
+
+    if (r->numVertices + nverts <= maxVertices)
+    {
+        std::memcpy (&r->vertices[r->numVertices], verts, sizeof (NVGvertex) * (size_t) nverts);
+        r->numVertices += nverts;
+    }
+}
+
+static void captureDelete (void*) {}
+
+static NVGcontext* createCaptureContext()
+{
+    NVGparams params {};
+    params.userPtr = &renderer;
+    params.allocator = &allocator;
+    params.edgeAntiAlias = 1;
+    params.renderCreate = captureCreate;
+    params.renderCreateTexture = captureCreateTexture;
+    params.renderDeleteTexture = captureDeleteTexture;
+    params.renderUpdateTexture = captureUpdateTexture;
+    params.renderGetTextureSize = captureGetTextureSize;
+    params.renderViewport = captureViewport;
+    params.renderCancel = captureCancel;
+    params.renderFlush = captureFlush;
+    params.renderFill = captureFill;
+    params.renderStroke = captureStroke;
+    params.renderTriangles = captureTriangles;
+    params.renderDelete = captureDelete;
+
+    return nvgCreateInternal (&params);
+}
+
+//==============================================================================
+
+static AttributedString createMixedText()
+{
+    AttributedString str;
+
+    str.append ("Gain ", Font ("Roboto", 14.0f, Font::plain), Colours::white);
+    str.append (String (CharPointer_UTF8 ("\xe2\x88\x92" "3.5 dB \xe2\x80\x94 ")), Font ("Roboto", 14.0f, Font::bold), Colours::yellow);
+    str.append (String (CharPointer_UTF8 ("Gr\xc3\xb6\xc3\x9f" "e ")), Font ("Verdana", 12.0f, Font::plain), Colours::white);
+    str.append (String (CharPointer_UTF8 ("\xc3\xa9t\xc3\xa9 \xc2\xb0" "C ")), Font ("Roboto", 18.0f, Font::plain), Colours::red);
+    str.append ("ASCII tail", Font ("Verdana", 12.0f, Font::plain), Colours::green);
+
+    return str;
+}
+
+/** Draws the attribute ranges of the string as substrings, the way drawTextLayout() should. */
+static void drawRangesDirectly (NVGcontext* nvg, NanovgGraphicsContext& context,
+                                const AttributedString& str, const Rectangle<float>& rect)
+{
+    float x {rect.getX()};
+
+    nvgSave (nvg);
+    nvgTextAlign (nvg, NVG_ALIGN_TOP);
+
+    for (int i = 0; i < str.getNumAttributes(); ++i)
+    {
+        const auto& attr = str.getAttribute (i);
+        const auto text = str.getText().substring (attr.range.getStart(), attr.range.getEnd());
+
+        context.setFont (attr.font);
+        nvgFillColor (nvg, nvgRGBA (attr.colour.getRed(), attr.colour.getGreen(), attr.colour.getBlue(), attr.colour.getAlpha()));
+        x = nvgText (nvg, x, rect.getY(), text.toRawUTF8(), nullptr);
+    }
+
+    nvgRestore (nvg);
+}
+
+int main()
+{
+    ScopedJuceInitialiser_GUI juceInitialiser;
+
+    constexpr int width {640};
+    constexpr int height {480};
+
+    auto* nvg = createCaptureContext();
+
+    if (nvg == nullptr)
+    {
+        std::cout << "Unable to create nanovg context" << std::endl;
+        return 1;
+    }
+
+    int failures {0};
+
+    {
+        NanovgGraphicsContext context (nvg, width, height);
+
+        const auto str = createMixedText();
+        const Rectangle<float> rect {10.0f, 10.0f, 600.0f, 40.0f};
+
+        // The walk over character ranges must not be tested on ASCII only.
+        if (str.getText().getNumBytesAsUTF8() == (size_t) str.getText().length())
+            ++failures;
+
+        OwnedArray<GlyphArrangement> glyphs;
+
+        for (int i = 0; i < str.getNumAttributes(); ++i)
+        {
+            const auto& attr = str.getAttribute (i);
+            auto* arrangement = glyphs.add (new GlyphArrangement());
+            arrangement->addLineOfText (attr.font,
+                                        str.getText().substring (attr.range.getStart(), attr.range.getEnd()),
+                                        rect.getX(), 80.0f + 30.0f * (float) i);
+        }
+
+        for (int frame = 0; frame < numFrames; ++frame)
+        {
+            nvgBeginFrame (nvg, (float) width, (float) height, 1.0f);
+
+            renderer.clear();
+
+            const int textureUpdatesBefore {renderer.numTextureUpdates};
+            const int allocationsBefore {getNumAllocations()};
+
+            context.setFill (Colours::white);
+            context.drawTextLayout (str, rect);
+
+            const int textAllocations {getNumAllocations() - allocationsBefore};
+            textLayout = renderer;
+
+            const int glyphAllocationsBefore {getNumAllocations()};
+
+            for (auto* arrangement : glyphs)
+            {
+                for (int i = 0; i < arrangement->getNumGlyphs(); ++i)
+                {
+                    const auto& glyph = arrangement->getGlyph (i);
+                    context.setFont (glyph.getFont());
+                    context.drawGlyph (glyph.getGlyphNumber(),
+                                       AffineTransform::translation (glyph.getLeft(), glyph.getBaselineY()));
+                }
+            }
+
+            const int glyphAllocations {getNumAllocations() - glyphAllocationsBefore};
+
+            // Character ranges drawn straight from the string must match the same substrings.
+            renderer.clear();
+            drawRangesDirectly (nvg, context, str, rect);
+
+            const bool rangesMatch {textLayout.numVertices > 0 && renderer.matches (textLayout)};
+
+            const int frameAllocationsBefore {getNumAllocations()};
+            nvgEndFrame (nvg);
+
+            const int frameAllocations {getNumAllocations() - frameAllocationsBefore};
+            const int textureUpdates {renderer.numTextureUpdates - textureUpdatesBefore};
+
+            std::cout << "frame " << frame
+                      << ": drawTextLayout " << textAllocations << " allocations, "
+                      << "drawGlyph " << glyphAllocations << " allocations, "
+                      << "end of frame " << frameAllocations << " allocations, "
+                      << textureUpdates << " texture updates, "
+                      << (rangesMatch ? "ranges match" : "ranges differ") << std::endl;
+
+            // Glyph coordinates change while the atlas grows during warm-up.
+            if (frame >= numWarmUpFrames
+                && (! rangesMatch || textAllocations != 0 || glyphAllocations != 0
+                    || frameAllocations != 0 || textureUpdates != 0))
+                ++failures;
+        }
+    }
+
+    nvgDeleteInternal (nvg);
+
+    std::cout << (failures == 0 ? "PASSED" : "FAILED") << std::endl;
+    return failures == 0 ? 0 : 1;
+}